@@ -0,0 +1,153 @@
+/**
+ * @file accounting.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Resource usage of the tree, rolled up per level.
+ *
+ * A forwarded level is one line: level, nodes, user and system CPU in microseconds, max RSS in KiB, minor and major
+ * faults, voluntary and involuntary context switches.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+#include "accounting.h"
+
+/** The summed usage of the nodes of one level, including their subtrees. */
+struct level {
+    unsigned long long nodes;
+    unsigned long long utime;
+    unsigned long long stime;
+    unsigned long long maxrss;
+    unsigned long long minflt;
+    unsigned long long majflt;
+    unsigned long long nvcsw;
+    unsigned long long nivcsw;
+};
+
+static struct level levels[ACCT_LEVELS];
+
+static unsigned long long micros(struct timeval tv) {
+    return (unsigned long long) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static unsigned long long minus(unsigned long long a, unsigned long long b) {
+    return a > b ? a - b : 0;
+}
+
+static void add_level(int level, const struct level *l) {
+    if (level < 0) {
+        return;
+    }
+    struct level *sum = &levels[level < ACCT_LEVELS ? level : ACCT_LEVELS - 1];
+    sum->nodes += l->nodes;
+    sum->utime += l->utime;
+    sum->stime += l->stime;
+    sum->maxrss = sum->maxrss > l->maxrss ? sum->maxrss : l->maxrss;
+    sum->minflt += l->minflt;
+    sum->majflt += l->majflt;
+    sum->nvcsw += l->nvcsw;
+    sum->nivcsw += l->nivcsw;
+}
+
+/**
+ * Account add function
+ * @brief This function adds the wait4() usage of a reaped child to its level.
+ * @param level The depth of the child
+ * @param ru The usage of the child and its subtree
+ */
+void acct_add(int level, const struct rusage *ru) {
+    struct level l = {
+        .nodes = 1,
+        .utime = micros(ru->ru_utime),
+        .stime = micros(ru->ru_stime),
+        .maxrss = ru->ru_maxrss,
+        .minflt = ru->ru_minflt,
+        .majflt = ru->ru_majflt,
+        .nvcsw = ru->ru_nvcsw,
+        .nivcsw = ru->ru_nivcsw
+    };
+    add_level(level, &l);
+}
+
+/**
+ * Account merge line function
+ * @brief This function adds a level a child forwarded (see acct_format()).
+ * @param line The forwarded line
+ */
+void acct_merge_line(const char *line) {
+    struct level l;
+    int level;
+    if (sscanf(line, "%d %llu %llu %llu %llu %llu %llu %llu %llu", &level, &l.nodes, &l.utime, &l.stime,
+               &l.maxrss, &l.minflt, &l.majflt, &l.nvcsw, &l.nivcsw) != 9) {
+        fprintf(stderr, "accounting: malformed usage line\n");
+        exit(EXIT_FAILURE);
+    }
+    add_level(level, &l);
+}
+
+/**
+ * Account count function
+ * @return The number of levels that hold nodes
+ */
+int acct_count(void) {
+    int count = 0;
+    for (int i = 0; i < ACCT_LEVELS; i++) {
+        count += levels[i].nodes > 0;
+    }
+    return count;
+}
+
+/**
+ * Account format function
+ * @brief This function formats a level that holds nodes as a line to forward, ending with a newline.
+ * @param index The index among the levels that hold nodes (below acct_count())
+ * @param buf The buffer
+ * @param size The size of the buffer
+ */
+void acct_format(int index, char *buf, size_t size) {
+    for (int i = 0; i < ACCT_LEVELS; i++) {
+        if (levels[i].nodes == 0 || index-- > 0) {
+            continue;
+        }
+        const struct level *l = &levels[i];
+        snprintf(buf, size, "%d %llu %llu %llu %llu %llu %llu %llu %llu\n", i, l->nodes, l->utime, l->stime,
+                 l->maxrss, l->minflt, l->majflt, l->nvcsw, l->nivcsw);
+        return;
+    }
+    buf[0] = '\0';
+}
+
+/**
+ * Account print function
+ * @brief This function prints the usage of the nodes of every level themselves, the root is level 0.
+ * @details The max RSS of a level is the largest of the level and its subtrees.
+ * @param stream The stream
+ */
+void acct_print(FILE *stream) {
+    struct rusage self;
+    getrusage(RUSAGE_SELF, &self);
+    acct_add(0, &self);
+
+    fprintf(stream, "%5s %8s %10s %10s %10s %10s %8s %10s %10s\n", "level", "nodes", "user[s]", "sys[s]",
+            "maxrss[KiB]", "minflt", "majflt", "vcsw", "ivcsw");
+    for (int i = 0; i < ACCT_LEVELS && levels[i].nodes > 0; i++) {
+        // the nodes of level i + 1 were reaped by the nodes of level i, so they are contained in level i
+        struct level own = levels[i];
+        if (i > 0 && i + 1 < ACCT_LEVELS) {
+            const struct level *below = &levels[i + 1];
+            own.utime = minus(own.utime, below->utime);
+            own.stime = minus(own.stime, below->stime);
+            own.minflt = minus(own.minflt, below->minflt);
+            own.majflt = minus(own.majflt, below->majflt);
+            own.nvcsw = minus(own.nvcsw, below->nvcsw);
+            own.nivcsw = minus(own.nivcsw, below->nivcsw);
+        }
+        fprintf(stream, "%5d %8llu %10.3f %10.3f %10llu %10llu %8llu %10llu %10llu\n", i, own.nodes,
+                own.utime / 1e6, own.stime / 1e6, own.maxrss, own.minflt, own.majflt, own.nvcsw, own.nivcsw);
+    }
+}
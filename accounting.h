@@ -0,0 +1,28 @@
+/**
+ * @file accounting.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Resource usage of the tree, rolled up per level.
+ *
+ * Every parent adds the wait4() usage of its children to the level below its own and forwards the table of its
+ * subtree to its parent after its sorted lines. The usage wait4() reports for a child includes the children it reaped,
+ * so the usage of the nodes of a level themselves is the difference of the level and the level below it.
+ **/
+
+#ifndef ACCOUNTING_H
+#define ACCOUNTING_H
+
+#include <stdio.h>
+#include <sys/resource.h>
+
+/** Defines the number of levels that are accounted, deeper nodes are added to the last level. */
+#define ACCT_LEVELS 64
+
+void acct_add(int level, const struct rusage *ru);
+void acct_merge_line(const char *line);
+int acct_count(void);
+void acct_format(int index, char *buf, size_t size);
+void acct_print(FILE *stream);
+
+#endif
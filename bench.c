@@ -0,0 +1,225 @@
+/**
+ * @file bench.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Latency benchmark of small sorts.
+ *
+ * Runs forksort many times on the same small input and prints the percentiles of the wall time of a run,
+ * from the fork of forksort to its exit, with the output going to /dev/null.
+ * Where the kernel exposes hardware counters, it also prints the instructions per cycle of all runs.
+ *
+ *  USAGE: forksort-bench [-n RUNS] [-l LINES] [-w WIDTH] [-p PROGRAM] [-- ARGS...]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/** The program name. */
+static char *pgm_name;
+
+static void error_exit(const char *msg) {
+    fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+static void usage(void) {
+    fprintf(stderr, "USAGE: %s [-n RUNS] [-l LINES] [-w WIDTH] [-p PROGRAM] [-- ARGS...]\n", pgm_name);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Create input function
+ * @brief This function writes the random input of all runs to a memfd.
+ * @param lines The number of lines
+ * @param width The length of a line without its newline
+ * @return The file descriptor of the input
+ */
+static int create_input(long lines, long width) {
+    int fd = memfd_create("forksort-bench", 0);
+    if (fd == -1) {
+        error_exit("Could not create input");
+    }
+    FILE *f = fdopen(dup(fd), "w");
+    if (f == NULL) {
+        error_exit("Could not open input");
+    }
+    unsigned long seed = 1;
+    for (long i = 0; i < lines; i++) {
+        for (long j = 0; j < width; j++) {
+            seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+            putc('a' + (seed >> 33) % 26, f);
+        }
+        putc('\n', f);
+    }
+    if (fclose(f) == EOF) {
+        error_exit("Could not write input");
+    }
+    return fd;
+}
+
+/**
+ * Open counter function
+ * @brief This function counts a hardware event in user space of this process and the children it starts afterwards.
+ * @return The file descriptor of the counter or -1
+ */
+static int open_counter(unsigned long long config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static unsigned long long read_counter(int fd) {
+    unsigned long long value = 0;
+    if (read(fd, &value, sizeof(value)) != sizeof(value)) {
+        return 0;
+    }
+    return value;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Run function
+ * @brief This function runs the program once on the input and exits if it fails.
+ * @return The wall time of the run in seconds
+ */
+static double run(char **argv, int in, int null) {
+    if (lseek(in, 0, SEEK_SET) == -1) {
+        error_exit("Could not rewind input");
+    }
+    double start = now();
+    pid_t pid = fork();
+    switch (pid) {
+        case -1:
+            error_exit("fork failed");
+        case 0:
+            if (dup2(in, STDIN_FILENO) == -1 || dup2(null, STDOUT_FILENO) == -1) {
+                error_exit("dup2 failed");
+            }
+            execv(argv[0], argv);
+            error_exit("exec failed");
+    }
+    int status;
+    if (waitpid(pid, &status, 0) == -1) {
+        error_exit("Error occured during waiting for the program");
+    }
+    double end = now();
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        fprintf(stderr, "%s failed\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    return end - start;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Percentile function
+ * @return The p-quantile of the sorted times (nearest rank)
+ */
+static double percentile(const double *times, long runs, double p) {
+    long rank = (long) (p * runs + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+    return times[rank - 1];
+}
+
+int main(int argc, char *argv[]) {
+    pgm_name = argv[0];
+    long runs = 1000, lines = 100, width = 16;
+    char *program = "./forksort";
+    int opt;
+    while ((opt = getopt(argc, argv, "n:l:w:p:")) != -1) {
+        switch (opt) {
+            case 'n':
+                runs = atol(optarg);
+                break;
+            case 'l':
+                lines = atol(optarg);
+                break;
+            case 'w':
+                width = atol(optarg);
+                break;
+            case 'p':
+                program = optarg;
+                break;
+            default:
+                usage();
+        }
+    }
+    if (runs < 1 || lines < 1 || width < 0) {
+        usage();
+    }
+
+    char **args = malloc((argc - optind + 2) * sizeof(*args));
+    double *times = malloc(runs * sizeof(*times));
+    if (args == NULL || times == NULL) {
+        error_exit("Unable to allocate memory");
+    }
+    args[0] = program;
+    for (int i = optind; i < argc; i++) {
+        args[i - optind + 1] = argv[i];
+    }
+    args[argc - optind + 1] = NULL;
+
+    int in = create_input(lines, width);
+    int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (null == -1) {
+        error_exit("Could not open /dev/null");
+    }
+
+    run(args, in, null);
+    int instructions = open_counter(PERF_COUNT_HW_INSTRUCTIONS);
+    int cycles = instructions == -1 ? -1 : open_counter(PERF_COUNT_HW_CPU_CYCLES);
+    const char *counter_error = cycles == -1 ? strerror(errno) : NULL;
+    double total = 0;
+    for (long i = 0; i < runs; i++) {
+        times[i] = run(args, in, null);
+        total += times[i];
+    }
+    qsort(times, runs, sizeof(*times), compare_double);
+
+    printf("%s", program);
+    for (int i = 1; args[i] != NULL; i++) {
+        printf(" %s", args[i]);
+    }
+    printf(": %ld runs of %ld lines\n", runs, lines);
+    printf("  mean %.3f ms  p50 %.3f ms  p99 %.3f ms  p999 %.3f ms  max %.3f ms\n", total / runs * 1e3,
+            percentile(times, runs, 0.5) * 1e3, percentile(times, runs, 0.99) * 1e3,
+            percentile(times, runs, 0.999) * 1e3, times[runs - 1] * 1e3);
+    if (cycles != -1) {
+        unsigned long long insns = read_counter(instructions), cyc = read_counter(cycles);
+        printf("  ipc %.3f  (%llu instructions, %llu cycles per run)\n", cyc > 0 ? (double) insns / cyc : 0.0,
+                insns / runs, cyc / runs);
+    } else {
+        printf("  ipc n/a  (perf_event_open: %s)\n", counter_error);
+    }
+
+    free(times);
+    free(args);
+    exit(EXIT_SUCCESS);
+}
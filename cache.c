@@ -0,0 +1,383 @@
+/**
+ * @file cache.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Content-addressed cache of sorted outputs.
+ *
+ * The input is hashed line by line while it is read, the digest names the cache entry.
+ * Hits are streamed with copy_fd(), misses are written to a temporary file
+ * that is renamed into place once the sort succeeded.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+#include "cache.h"
+
+#define P1 0x9E3779B185EBCA87ULL
+#define P2 0xC2B2AE3D27D4EB4FULL
+#define P3 0x165667B19E3779F9ULL
+#define P4 0x85EBCA77C2B2AE63ULL
+#define P5 0x27D4EB2F165667C5ULL
+
+/** Defines the chunk size used when the kernel copy functions are not available. */
+#define COPY_CHUNK (64 * 1024)
+
+static uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t read32(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t round64(uint64_t acc, uint64_t in) {
+    acc += in * P2;
+    acc = rotl(acc, 31);
+    return acc * P1;
+}
+
+static uint64_t merge64(uint64_t acc, uint64_t val) {
+    acc ^= round64(0, val);
+    return acc * P1 + P4;
+}
+
+/**
+ * Hash function
+ * @brief This function hashes a byte string (xxHash64 construction).
+ * @details Strings of 32 bytes or more are consumed by four independent lanes, so the multiplications
+ * of one stripe do not depend on each other and the hash runs at memory speed.
+ * @param p The bytes to hash
+ * @param len The number of bytes
+ * @param seed The seed of the hash
+ * @return The 64 bit hash
+ */
+static uint64_t hash64(const char *p, size_t len, uint64_t seed) {
+    const char *end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        uint64_t v1 = seed + P1 + P2;
+        uint64_t v2 = seed + P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - P1;
+        do {
+            v1 = round64(v1, read64(p));
+            v2 = round64(v2, read64(p + 8));
+            v3 = round64(v3, read64(p + 16));
+            v4 = round64(v4, read64(p + 24));
+            p += 32;
+        } while (p + 32 <= end);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge64(h, v1);
+        h = merge64(h, v2);
+        h = merge64(h, v3);
+        h = merge64(h, v4);
+    } else {
+        h = seed + P5;
+    }
+
+    h += len;
+    for (; p + 8 <= end; p += 8) {
+        h ^= round64(0, read64(p));
+        h = rotl(h, 27) * P1 + P4;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t) read32(p) * P1;
+        h = rotl(h, 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= (unsigned char) *p * P5;
+        h = rotl(h, 11) * P1;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+/**
+ * Hash init function
+ * @brief This function initializes an input digest.
+ * @param hash The digest
+ */
+void cache_hash_init(struct cache_hash *hash) {
+    hash->h[0] = P1;
+    hash->h[1] = P2;
+    hash->total = 0;
+    hash->lines = 0;
+}
+
+/**
+ * Hash update function
+ * @brief This function adds one line (or any other chunk, such as the sort options) to the digest.
+ * @details Every chunk is hashed on its own and chained into two differently mixed 64 bit states,
+ * so the digest depends on the order and the boundaries of the chunks.
+ * @param hash The digest
+ * @param data The chunk
+ * @param len The length of the chunk
+ */
+void cache_hash_update(struct cache_hash *hash, const char *data, size_t len) {
+    uint64_t lh = hash64(data, len, hash->lines);
+    hash->h[0] = rotl(hash->h[0] ^ lh, 29) * P1 + P4;
+    hash->h[1] = rotl(hash->h[1] + lh * P3, 37) * P2 + P5;
+    hash->total += len;
+    hash->lines += 1;
+}
+
+/**
+ * Hash final function
+ * @brief This function writes the digest as a hex string.
+ * @param hash The digest
+ * @param key The buffer the hex string is written to
+ */
+void cache_hash_final(const struct cache_hash *hash, char key[CACHE_KEY_LEN + 1]) {
+    uint64_t h0 = merge64(hash->h[0], hash->total);
+    uint64_t h1 = merge64(hash->h[1], hash->lines);
+    h0 ^= h0 >> 33;
+    h0 *= P2;
+    h0 ^= h0 >> 29;
+    h1 ^= h1 >> 32;
+    h1 *= P3;
+    h1 ^= h1 >> 31;
+    snprintf(key, CACHE_KEY_LEN + 1, "%016llx%016llx", (unsigned long long) h0, (unsigned long long) h1);
+}
+
+/**
+ * Copy function
+ * @brief This function copies everything from in_fd (starting at its current offset) to out_fd.
+ * @details copy_file_range() is tried first (regular file to regular file, may share extents), then sendfile()
+ * (regular file to anything), then a plain read/write loop.
+ * @param in_fd The file descriptor that is read from
+ * @param out_fd The file descriptor that is written to
+ */
+void copy_fd(int in_fd, int out_fd) {
+    ssize_t n;
+
+    while ((n = copy_file_range(in_fd, NULL, out_fd, NULL, COPY_CHUNK * 16, 0)) > 0) {
+    }
+    if (n == 0) {
+        return;
+    }
+
+    while ((n = sendfile(out_fd, in_fd, NULL, COPY_CHUNK * 16)) > 0) {
+    }
+    if (n == 0) {
+        return;
+    }
+
+    char buf[COPY_CHUNK];
+    while ((n = read(in_fd, buf, sizeof(buf))) > 0) {
+        char *p = buf;
+        while (n > 0) {
+            ssize_t w = write(out_fd, p, n);
+            if (w == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fprintf(stderr, "Could not write output: %s\n", strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            p += w;
+            n -= w;
+        }
+    }
+    if (n == -1) {
+        fprintf(stderr, "Could not read output: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Entry path function
+ * @brief This function allocates the path of a file in the cache directory.
+ * @param dir The cache directory
+ * @param name The file name
+ * @return The allocated path
+ */
+static char *entry_path(const char *dir, const char *name) {
+    size_t len = strlen(dir) + strlen(name) + 2;
+    char *path = malloc(len);
+    if (path == NULL) {
+        fprintf(stderr, "cache: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(path, len, "%s/%s", dir, name);
+    return path;
+}
+
+/**
+ * Lookup function
+ * @brief This function opens the entry of cache->key if it exists.
+ * @details The modification time of a hit is set to now, which is the recency used by the LRU eviction.
+ * @param cache The cache
+ * @return The file descriptor of the entry on a hit, -1 on a miss
+ */
+int cache_lookup(struct cache *cache) {
+    char *path = entry_path(cache->dir, cache->key);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    free(path);
+    if (fd == -1) {
+        return -1;
+    }
+
+    if (futimens(fd, NULL) == -1) {
+        fprintf(stderr, "cache: could not touch entry %s: %s\n", cache->key, strerror(errno));
+    }
+    return fd;
+}
+
+/**
+ * Store begin function
+ * @brief This function creates the temporary file that a missed entry is written to.
+ * @param cache The cache
+ * @return The file descriptor of the temporary file or -1 if the cache directory is not usable
+ */
+int cache_store_begin(struct cache *cache) {
+    if (mkdir(cache->dir, 0777) == -1 && errno != EEXIST) {
+        fprintf(stderr, "cache: could not create %s: %s\n", cache->dir, strerror(errno));
+        return -1;
+    }
+
+    cache->tmp_path = entry_path(cache->dir, ".tmp.XXXXXX");
+    cache->tmp_fd = mkostemp(cache->tmp_path, O_CLOEXEC);
+    if (cache->tmp_fd == -1) {
+        fprintf(stderr, "cache: could not create temporary file in %s: %s\n", cache->dir, strerror(errno));
+        free(cache->tmp_path);
+        cache->tmp_path = NULL;
+    }
+    return cache->tmp_fd;
+}
+
+/** A cache entry as seen by the eviction. */
+struct entry {
+    char name[CACHE_KEY_LEN + 1];
+    off_t size;
+    struct timespec mtime;
+};
+
+static int cmp_entry(const void *a, const void *b) {
+    const struct entry *x = a;
+    const struct entry *y = b;
+    if (x->mtime.tv_sec != y->mtime.tv_sec) {
+        return x->mtime.tv_sec < y->mtime.tv_sec ? -1 : 1;
+    }
+    if (x->mtime.tv_nsec != y->mtime.tv_nsec) {
+        return x->mtime.tv_nsec < y->mtime.tv_nsec ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * Evict function
+ * @brief This function removes the least recently used entries until the cache fits into its size bound.
+ * @param cache The cache
+ */
+static void evict(struct cache *cache) {
+    DIR *dir = opendir(cache->dir);
+    if (dir == NULL) {
+        return;
+    }
+
+    struct entry *entries = NULL;
+    size_t count = 0, cap = 0;
+    off_t total = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if (strlen(de->d_name) != CACHE_KEY_LEN) {
+            continue;
+        }
+        struct stat st;
+        if (fstatat(dirfd(dir), de->d_name, &st, 0) == -1 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            struct entry *grown = realloc(entries, cap * sizeof(*entries));
+            if (grown == NULL) {
+                break;
+            }
+            entries = grown;
+        }
+        memcpy(entries[count].name, de->d_name, CACHE_KEY_LEN + 1);
+        entries[count].size = st.st_size;
+        entries[count].mtime = st.st_mtim;
+        total += st.st_size;
+        count += 1;
+    }
+
+    if (total > cache->limit) {
+        qsort(entries, count, sizeof(*entries), cmp_entry);
+        for (size_t i = 0; i < count && total > cache->limit; i++) {
+            if (strcmp(entries[i].name, cache->key) == 0) {
+                continue;
+            }
+            if (unlinkat(dirfd(dir), entries[i].name, 0) == 0) {
+                total -= entries[i].size;
+            }
+        }
+    }
+
+    free(entries);
+    closedir(dir);
+}
+
+/**
+ * Store commit function
+ * @brief This function moves the completely written temporary file into place and enforces the size bound.
+ * @param cache The cache
+ * @return true if the entry was stored
+ */
+bool cache_store_commit(struct cache *cache) {
+    char *path = entry_path(cache->dir, cache->key);
+    bool stored = rename(cache->tmp_path, path) == 0;
+    if (!stored) {
+        fprintf(stderr, "cache: could not store entry %s: %s\n", cache->key, strerror(errno));
+        unlink(cache->tmp_path);
+    }
+    free(path);
+    free(cache->tmp_path);
+    cache->tmp_path = NULL;
+
+    if (stored) {
+        evict(cache);
+    }
+    return stored;
+}
+
+/**
+ * Store abort function
+ * @brief This function removes the temporary file of an entry that could not be completed.
+ * @param cache The cache
+ */
+void cache_store_abort(struct cache *cache) {
+    if (cache->tmp_path != NULL) {
+        unlink(cache->tmp_path);
+        free(cache->tmp_path);
+        cache->tmp_path = NULL;
+    }
+    if (cache->tmp_fd != -1) {
+        close(cache->tmp_fd);
+        cache->tmp_fd = -1;
+    }
+}
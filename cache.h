@@ -0,0 +1,50 @@
+/**
+ * @file cache.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Content-addressed cache of sorted outputs.
+ *
+ * Sorted outputs are stored in a cache directory under the digest of their input and the sort options.
+ * The directory is kept below a size bound by evicting the least recently used entries.
+ **/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/** Length of a digest in hex characters (128 bit). */
+#define CACHE_KEY_LEN 32
+
+/** Incremental digest of the input lines. */
+struct cache_hash {
+    uint64_t h[2];
+    uint64_t total;
+    uint64_t lines;
+};
+
+/** An opened cache directory. */
+struct cache {
+    const char *dir;
+    off_t limit;
+    char key[CACHE_KEY_LEN + 1];
+    char *tmp_path;
+    int tmp_fd;
+};
+
+void cache_hash_init(struct cache_hash *hash);
+void cache_hash_update(struct cache_hash *hash, const char *data, size_t len);
+void cache_hash_final(const struct cache_hash *hash, char key[CACHE_KEY_LEN + 1]);
+
+int cache_lookup(struct cache *cache);
+int cache_store_begin(struct cache *cache);
+bool cache_store_commit(struct cache *cache);
+void cache_store_abort(struct cache *cache);
+
+void copy_fd(int in_fd, int out_fd);
+
+#endif
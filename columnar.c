@@ -0,0 +1,380 @@
+/**
+ * @file columnar.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Sorting of a columnar binary stream by key columns (--columnar=KEYS).
+ *
+ * The columns of all batches are read into one array each. Every row gets a fixed-size key record: the key columns
+ * in an order-preserving binary form (see encode_key()) followed by the row number, so the records are sorted
+ * bytewise by the in-place engine, with its word kernels when the record is 16 bytes wide (one numeric key). Equal keys
+ * keep their input order. The row numbers of the sorted records are the permutation, which is then applied to one
+ * column after the other, batch by batch, so every gather reads a single column.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "columnar.h"
+#include "inplace.h"
+
+/** The magic bytes at the start of a stream. */
+static const char MAGIC[8] = { 'F', 'S', 'C', 'O', 'L', '1', '\0', '\0' };
+
+/** A column of all rows read so far. */
+struct column {
+    int type;
+    char *name;
+    size_t name_len;
+    unsigned char *data;
+    size_t size, cap;
+    uint64_t *offsets;
+};
+
+/** A key column and where its encoding lies in the key record. */
+struct key {
+    size_t column;
+    bool descending;
+    size_t offset, width;
+};
+
+/**
+ * Columnar error function
+ * @brief This function writes an error of the columnar sort to stderr and exits with an EXIT_FAILURE status
+ * @param msg The message
+ */
+static void columnar_error(const char *msg) {
+    fprintf(stderr, "columnar: %s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+static void *columnar_alloc(void *p, size_t size) {
+    p = realloc(p, size > 0 ? size : 1);
+    if (p == NULL) {
+        columnar_error("Unable to allocate memory");
+    }
+    return p;
+}
+
+static void read_exact(FILE *in, void *buf, size_t n) {
+    if (fread(buf, 1, n, in) != n) {
+        columnar_error(ferror(in) ? strerror(errno) : "truncated stream");
+    }
+}
+
+static void write_exact(FILE *out, const void *buf, size_t n) {
+    if (fwrite(buf, 1, n, out) != n) {
+        columnar_error("could not write output");
+    }
+}
+
+static uint64_t get_le(const unsigned char *p, int bytes) {
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        v = v << 8 | p[i];
+    }
+    return v;
+}
+
+static void put_le(unsigned char *p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        p[i] = (unsigned char) (v >> (8 * i));
+    }
+}
+
+static void put_be64(unsigned char *p, uint64_t v) {
+    for (int i = 7; i >= 0; i--) {
+        p[i] = (unsigned char) v;
+        v >>= 8;
+    }
+}
+
+static uint64_t read_u64(FILE *in) {
+    unsigned char buf[8];
+    read_exact(in, buf, sizeof(buf));
+    return get_le(buf, 8);
+}
+
+static void write_u64(FILE *out, uint64_t v) {
+    unsigned char buf[8];
+    put_le(buf, v, 8);
+    write_exact(out, buf, sizeof(buf));
+}
+
+static void append(struct column *c, FILE *in, size_t n) {
+    if (c->size + n > c->cap) {
+        c->cap = 2 * (c->size + n);
+        c->data = columnar_alloc(c->data, c->cap);
+    }
+    read_exact(in, c->data + c->size, n);
+    c->size += n;
+}
+
+/**
+ * Read header function
+ * @brief This function reads the header of a stream.
+ * @param numcols Set to the number of columns
+ * @return The columns, without rows
+ */
+static struct column *read_header(FILE *in, size_t *numcols) {
+    char magic[sizeof(MAGIC)];
+    read_exact(in, magic, sizeof(magic));
+    if (memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        columnar_error("not a columnar stream");
+    }
+    unsigned char buf[4];
+    read_exact(in, buf, 4);
+    *numcols = get_le(buf, 4);
+    if (*numcols == 0) {
+        columnar_error("the stream has no columns");
+    }
+
+    struct column *cols = columnar_alloc(NULL, *numcols * sizeof(*cols));
+    for (size_t i = 0; i < *numcols; i++) {
+        struct column *c = &cols[i];
+        read_exact(in, buf, 3);
+        *c = (struct column) { .type = buf[0], .name_len = get_le(buf + 1, 2), .data = NULL, .size = 0, .cap = 0 };
+        if (c->type < COLUMNAR_INT64 || c->type > COLUMNAR_BYTES) {
+            columnar_error("unknown column type");
+        }
+        c->name = columnar_alloc(NULL, c->name_len);
+        read_exact(in, c->name, c->name_len);
+        c->offsets = c->type == COLUMNAR_BYTES ? columnar_alloc(NULL, sizeof(*c->offsets)) : NULL;
+        if (c->offsets != NULL) {
+            c->offsets[0] = 0;
+        }
+    }
+    return cols;
+}
+
+/**
+ * Read batches function
+ * @brief This function appends the rows of all batches to the columns.
+ * @return The number of rows
+ */
+static size_t read_batches(FILE *in, struct column *cols, size_t numcols) {
+    size_t numrows = 0;
+    uint64_t rows;
+    while ((rows = read_u64(in)) > 0) {
+        for (size_t i = 0; i < numcols; i++) {
+            struct column *c = &cols[i];
+            if (c->type != COLUMNAR_BYTES) {
+                append(c, in, rows * 8);
+                continue;
+            }
+            c->offsets = columnar_alloc(c->offsets, (numrows + rows + 1) * sizeof(*c->offsets));
+            uint64_t base = c->offsets[numrows], prev = 0;
+            for (size_t r = 0; r <= rows; r++) {
+                uint64_t off = read_u64(in);
+                if ((r == 0 && off != 0) || off < prev) {
+                    columnar_error("invalid offsets");
+                }
+                c->offsets[numrows + r] = base + off;
+                prev = off;
+            }
+            append(c, in, prev);
+        }
+        numrows += rows;
+    }
+    return numrows;
+}
+
+/**
+ * Parse keys function
+ * @brief This function parses the key columns and exits if one does not exist.
+ * @param numkeys Set to the number of keys
+ * @return The keys, permutation() lays out their encodings
+ */
+static struct key *parse_keys(const char *spec, size_t numcols, size_t *numkeys) {
+    struct key *keys = NULL;
+    *numkeys = 0;
+    const char *p = spec;
+    do {
+        bool descending = *p == '-';
+        p += descending ? 1 : 0;
+        char *end;
+        errno = 0;
+        unsigned long col = strtoul(p, &end, 10);
+        if (end == p || errno != 0 || col < 1 || col > numcols || (*end != ',' && *end != '\0') || (*end == ',' && end[1] == '\0')) {
+            columnar_error("invalid key columns");
+        }
+        keys = columnar_alloc(keys, (*numkeys + 1) * sizeof(*keys));
+        keys[(*numkeys)++] = (struct key) { .column = col - 1, .descending = descending };
+        p = *end == ',' ? end + 1 : end;
+    } while (*p != '\0');
+    return keys;
+}
+
+/**
+ * Encode key function
+ * @brief This function writes the order-preserving form of a value into a key record.
+ * @details Integers and floats become 8 big-endian bytes: int64 with its sign bit flipped, float64 with its sign bit
+ * flipped if it is positive and all bits flipped if it is negative (IEEE total order). A bytes value is padded with
+ * zeros to the width of the longest one and followed by its length, so a prefix sorts first. A descending key is
+ * inverted.
+ */
+static void encode_key(const struct key *k, const struct column *c, size_t row, unsigned char *dst) {
+    if (c->type == COLUMNAR_BYTES) {
+        uint64_t off = c->offsets[row], len = c->offsets[row + 1] - off;
+        memcpy(dst, c->data + off, len);
+        memset(dst + len, 0, k->width - 8 - len);
+        put_be64(dst + k->width - 8, len);
+    } else {
+        uint64_t v = get_le(c->data + row * 8, 8);
+        if (c->type == COLUMNAR_INT64) {
+            v ^= UINT64_C(1) << 63;
+        } else if (c->type == COLUMNAR_FLOAT64) {
+            v = v >> 63 ? ~v : v ^ UINT64_C(1) << 63;
+        }
+        put_be64(dst, v);
+    }
+    if (k->descending) {
+        for (size_t i = 0; i < k->width; i++) {
+            dst[i] = ~dst[i];
+        }
+    }
+}
+
+/**
+ * Permutation function
+ * @brief This function sorts the key records of all rows and returns the row numbers in sorted order.
+ */
+static uint64_t *permutation(const struct column *cols, struct key *keys, size_t numkeys, size_t numrows, int jobs) {
+    size_t record_size = 0;
+    for (size_t k = 0; k < numkeys; k++) {
+        const struct column *c = &cols[keys[k].column];
+        keys[k].offset = record_size;
+        keys[k].width = 8;
+        if (c->type == COLUMNAR_BYTES) {
+            for (size_t r = 0; r < numrows; r++) {
+                uint64_t len = c->offsets[r + 1] - c->offsets[r];
+                keys[k].width = len + 8 > keys[k].width ? len + 8 : keys[k].width;
+            }
+        }
+        record_size += keys[k].width;
+    }
+    // the row number breaks ties
+    record_size += 8;
+
+    uint64_t *perm = columnar_alloc(NULL, numrows * sizeof(*perm));
+    if (numrows == 0) {
+        return perm;
+    }
+
+    // the workers of the in-place engine sort a shared mapping
+    size_t size = numrows * record_size;
+    unsigned char *records = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (records == MAP_FAILED) {
+        columnar_error("could not allocate key records");
+    }
+    for (size_t r = 0; r < numrows; r++) {
+        unsigned char *rec = records + r * record_size;
+        for (size_t k = 0; k < numkeys; k++) {
+            encode_key(&keys[k], &cols[keys[k].column], r, rec + keys[k].offset);
+        }
+        put_be64(rec + record_size - 8, r);
+    }
+
+    inplace_sort_records((char *) records, numrows, record_size, jobs);
+
+    for (size_t r = 0; r < numrows; r++) {
+        const unsigned char *p = records + r * record_size + record_size - 8;
+        uint64_t v = 0;
+        for (int i = 0; i < 8; i++) {
+            v = v << 8 | p[i];
+        }
+        perm[r] = v;
+    }
+    munmap(records, size);
+    return perm;
+}
+
+static void write_header(FILE *out, const struct column *cols, size_t numcols) {
+    unsigned char buf[4];
+    write_exact(out, MAGIC, sizeof(MAGIC));
+    put_le(buf, numcols, 4);
+    write_exact(out, buf, 4);
+    for (size_t i = 0; i < numcols; i++) {
+        buf[0] = (unsigned char) cols[i].type;
+        put_le(buf + 1, cols[i].name_len, 2);
+        write_exact(out, buf, 3);
+        write_exact(out, cols[i].name, cols[i].name_len);
+    }
+}
+
+/**
+ * Write batches function
+ * @brief This function writes the rows in the order of the permutation, gathering one column of a batch at a time.
+ */
+static void write_batches(FILE *out, const struct column *cols, size_t numcols, const uint64_t *perm, size_t numrows) {
+    unsigned char *buf = NULL;
+    size_t cap = 0;
+    for (size_t first = 0; first < numrows; first += COLUMNAR_BATCH) {
+        size_t rows = numrows - first < COLUMNAR_BATCH ? numrows - first : COLUMNAR_BATCH;
+        const uint64_t *p = perm + first;
+        write_u64(out, rows);
+        for (size_t i = 0; i < numcols; i++) {
+            const struct column *c = &cols[i];
+            size_t need = c->type == COLUMNAR_BYTES ? (rows + 1) * 8 : rows * 8;
+            if (need > cap) {
+                cap = need;
+                buf = columnar_alloc(buf, cap);
+            }
+            if (c->type != COLUMNAR_BYTES) {
+                for (size_t r = 0; r < rows; r++) {
+                    memcpy(buf + r * 8, c->data + p[r] * 8, 8);
+                }
+                write_exact(out, buf, rows * 8);
+                continue;
+            }
+            uint64_t off = 0;
+            for (size_t r = 0; r < rows; r++) {
+                put_le(buf + r * 8, off, 8);
+                off += c->offsets[p[r] + 1] - c->offsets[p[r]];
+            }
+            put_le(buf + rows * 8, off, 8);
+            write_exact(out, buf, (rows + 1) * 8);
+            for (size_t r = 0; r < rows; r++) {
+                write_exact(out, c->data + c->offsets[p[r]], c->offsets[p[r] + 1] - c->offsets[p[r]]);
+            }
+        }
+    }
+    write_u64(out, 0);
+    free(buf);
+}
+
+/**
+ * Columnar sort function
+ * @brief This function sorts a columnar stream by its key columns.
+ * @param in The stream
+ * @param out The sorted stream
+ * @param keys The key columns, e.g. "2,-1"
+ * @param jobs The number of worker processes of the in-place engine
+ */
+void columnar_sort(FILE *in, FILE *out, const char *keys, int jobs) {
+    size_t numcols, numkeys;
+    struct column *cols = read_header(in, &numcols);
+    struct key *key = parse_keys(keys, numcols, &numkeys);
+    size_t numrows = read_batches(in, cols, numcols);
+
+    uint64_t *perm = permutation(cols, key, numkeys, numrows, jobs);
+    write_header(out, cols, numcols);
+    write_batches(out, cols, numcols, perm, numrows);
+    if (fflush(out) == EOF) {
+        columnar_error("could not write output");
+    }
+
+    free(perm);
+    free(key);
+    for (size_t i = 0; i < numcols; i++) {
+        free(cols[i].name);
+        free(cols[i].data);
+        free(cols[i].offsets);
+    }
+    free(cols);
+}
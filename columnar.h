@@ -0,0 +1,38 @@
+/**
+ * @file columnar.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Sorting of a columnar binary stream by key columns (--columnar=KEYS).
+ *
+ * The stream is a header followed by batches, all integers little-endian:
+ *
+ *     header := "FSCOL1\0\0" u32:columns { u8:type u16:name_length name }*columns
+ *     batch  := u64:rows { column }*columns            rows > 0
+ *     end    := u64:0
+ *
+ * A fixed column (COLUMNAR_INT64, COLUMNAR_UINT64, COLUMNAR_FLOAT64) is rows values of 8 bytes. A COLUMNAR_BYTES
+ * column is rows + 1 u64 offsets, starting at 0 and not decreasing, followed by offsets[rows] bytes; value i is the
+ * bytes from offsets[i] to offsets[i + 1]. Values are never null.
+ *
+ * KEYS lists the key columns by number (starting at 1), most significant first, a '-' sorts a column descending.
+ * The output has the header of the input and the rows in order, in batches of up to COLUMNAR_BATCH rows.
+ **/
+
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+#include <stdio.h>
+
+/** The column types. */
+#define COLUMNAR_INT64 1
+#define COLUMNAR_UINT64 2
+#define COLUMNAR_FLOAT64 3
+#define COLUMNAR_BYTES 4
+
+/** Defines the number of rows per output batch. */
+#define COLUMNAR_BATCH 65536
+
+void columnar_sort(FILE *in, FILE *out, const char *keys, int jobs);
+
+#endif
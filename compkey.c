@@ -0,0 +1,80 @@
+/**
+ * @file compkey.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Lines with a derived binary sort key in front of the record.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "compkey.h"
+
+static bool active = false;
+
+void compkey_enable(void) {
+    active = true;
+}
+
+bool compkey_active(void) {
+    return active;
+}
+
+/**
+ * Compkey line function
+ * @brief This function builds the composite line of a record and its key.
+ * @param key The key
+ * @param keylen The length of the key
+ * @param record The record without its newline
+ * @param reclen The length of the record
+ * @return The composite line, ending with a newline, allocated with malloc()
+ */
+char *compkey_line(const unsigned char *key, size_t keylen, const char *record, size_t reclen) {
+    size_t packed = (keylen * 8 + 6) / 7;
+    char *line = malloc(packed + 1 + reclen + 2);
+    if (line == NULL) {
+        fprintf(stderr, "compkey: Unable to allocate memory for line\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t o = 0;
+    uint32_t acc = 0;
+    int have = 0;
+    for (size_t i = 0; i < keylen; i++) {
+        acc = acc << 8 | key[i];
+        have += 8;
+        while (have >= 7) {
+            have -= 7;
+            line[o++] = (char) (0x80 | ((acc >> have) & 0x7f));
+        }
+    }
+    if (have > 0) {
+        line[o++] = (char) (0x80 | ((acc << (7 - have)) & 0x7f));
+    }
+    line[o++] = COMPKEY_SEPARATOR;
+    memcpy(line + o, record, reclen);
+    o += reclen;
+    line[o++] = '\n';
+    line[o] = '\0';
+    return line;
+}
+
+/**
+ * Compkey record function
+ * @brief This function finds the record of a composite line.
+ * @param line The composite line without its newline
+ * @param len The length of the line
+ * @param reclen Set to the length of the record
+ * @return The record inside the line
+ */
+const char *compkey_record(const char *line, size_t len, size_t *reclen) {
+    size_t i = 0;
+    while (i < len && (unsigned char) line[i] >= 0x80) {
+        i++;
+    }
+    i = i < len ? i + 1 : len;
+    *reclen = len - i;
+    return line + i;
+}
@@ -0,0 +1,29 @@
+/**
+ * @file compkey.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Lines with a derived binary sort key in front of the record.
+ *
+ * When the order is given by a key derived from each record, the root replaces every record by a composite line:
+ * the key packed 7 bits per byte into the bytes 0x80 to 0xff, the separator 0x01 and the record. Packed keys compare
+ * like the keys (a shorter key that is a prefix of a longer one sorts first, since 0x01 is below every packed byte),
+ * so the tree keeps sorting with the plain byte compare and equal keys fall back to the record.
+ * The root strips the key when it prints the line.
+ **/
+
+#ifndef COMPKEY_H
+#define COMPKEY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Defines the byte between the packed key and the record. */
+#define COMPKEY_SEPARATOR '\x01'
+
+void compkey_enable(void);
+bool compkey_active(void);
+char *compkey_line(const unsigned char *key, size_t keylen, const char *record, size_t reclen);
+const char *compkey_record(const char *line, size_t len, size_t *reclen);
+
+#endif
@@ -0,0 +1,555 @@
+/**
+ * @file dfa.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Regular expressions compiled to a deterministic automaton, matched against the start of a line.
+ *
+ * The pattern is parsed by recursive descent into a Thompson NFA (byte set, split and epsilon states), a bound {m,n}
+ * parses its atom again for every copy. The subset construction then turns the NFA into a table of 256 transitions
+ * per state, so matching costs one table lookup per byte and stops at the first accepting or dead state.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "dfa.h"
+
+/** The kinds of NFA states. */
+enum nfa_type {
+    NFA_SET,
+    NFA_SPLIT,
+    NFA_EPS,
+    NFA_MATCH
+};
+
+/** An NFA state: a byte set leading to out, a split to out and out1, an epsilon to out or the match. */
+struct nfa_state {
+    enum nfa_type type;
+    int out, out1;
+    uint8_t set[32];
+};
+
+/** An unconnected exit of a fragment: out (which 0) or out1 (which 1) of a state. */
+struct hole {
+    int state;
+    int which;
+};
+
+/** A partial NFA with one entry and a list of unconnected exits, start -1 after an error. */
+struct frag {
+    int start;
+    struct hole *holes;
+    int nholes;
+};
+
+struct parser {
+    const char *p;
+    const char *error;
+    struct nfa_state *states;
+    int count, cap;
+};
+
+struct dfa {
+    int nstates;
+    int start;
+    int32_t (*next)[256];
+    bool *accept;
+};
+
+static void *dfa_alloc(void *p, size_t size) {
+    p = realloc(p, size > 0 ? size : 1);
+    if (p == NULL) {
+        fprintf(stderr, "dfa: Unable to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static int add_state(struct parser *ps, enum nfa_type type, int out, int out1) {
+    if (ps->count == ps->cap) {
+        ps->cap = ps->cap == 0 ? 64 : 2 * ps->cap;
+        ps->states = dfa_alloc(ps->states, ps->cap * sizeof(*ps->states));
+    }
+    struct nfa_state *s = &ps->states[ps->count];
+    s->type = type;
+    s->out = out;
+    s->out1 = out1;
+    memset(s->set, 0, sizeof(s->set));
+    return ps->count++;
+}
+
+static void set_add(uint8_t *set, unsigned c) {
+    set[c / 8] |= 1 << (c % 8);
+}
+
+static bool set_has(const uint8_t *set, unsigned c) {
+    return set[c / 8] & (1 << (c % 8));
+}
+
+static struct frag fail(struct parser *ps, const char *error) {
+    if (ps->error == NULL) {
+        ps->error = error;
+    }
+    return (struct frag) { .start = -1, .holes = NULL, .nholes = 0 };
+}
+
+static struct frag single(struct parser *ps, int state, int which) {
+    struct frag f = { .start = state, .nholes = 1 };
+    f.holes = dfa_alloc(NULL, sizeof(*f.holes));
+    f.holes[0] = (struct hole) { .state = state, .which = which };
+    return f;
+}
+
+static void patch(struct parser *ps, struct frag *f, int target) {
+    for (int i = 0; i < f->nholes; i++) {
+        struct nfa_state *s = &ps->states[f->holes[i].state];
+        if (f->holes[i].which == 0) {
+            s->out = target;
+        } else {
+            s->out1 = target;
+        }
+    }
+    free(f->holes);
+    f->holes = NULL;
+    f->nholes = 0;
+}
+
+static void join_holes(struct frag *f, struct frag *g) {
+    f->holes = dfa_alloc(f->holes, (f->nholes + g->nholes) * sizeof(*f->holes));
+    memcpy(f->holes + f->nholes, g->holes, g->nholes * sizeof(*g->holes));
+    f->nholes += g->nholes;
+    free(g->holes);
+}
+
+static struct frag epsilon(struct parser *ps) {
+    return single(ps, add_state(ps, NFA_EPS, -1, -1), 0);
+}
+
+static struct frag concat(struct parser *ps, struct frag a, struct frag b) {
+    patch(ps, &a, b.start);
+    return (struct frag) { .start = a.start, .holes = b.holes, .nholes = b.nholes };
+}
+
+static struct frag star(struct parser *ps, struct frag a) {
+    int s = add_state(ps, NFA_SPLIT, a.start, -1);
+    patch(ps, &a, s);
+    return single(ps, s, 1);
+}
+
+static struct frag plus(struct parser *ps, struct frag a) {
+    int s = add_state(ps, NFA_SPLIT, a.start, -1);
+    patch(ps, &a, s);
+    struct frag f = single(ps, s, 1);
+    f.start = a.start;
+    return f;
+}
+
+static struct frag quest(struct parser *ps, struct frag a) {
+    int s = add_state(ps, NFA_SPLIT, a.start, -1);
+    struct frag f = single(ps, s, 1);
+    join_holes(&f, &a);
+    return f;
+}
+
+/**
+ * Escape set function
+ * @brief This function adds the bytes of the escape \c to a set.
+ */
+static void escape_set(uint8_t *set, unsigned char c) {
+    int (*class)(int) = NULL;
+    switch (c) {
+        case 'd':
+        case 'D':
+            class = isdigit;
+            break;
+        case 's':
+        case 'S':
+            class = isspace;
+            break;
+        case 'w':
+        case 'W':
+            class = isalnum;
+            break;
+    }
+    if (class == NULL) {
+        set_add(set, c == 't' ? '\t' : c);
+        return;
+    }
+    bool negate = isupper(c);
+    for (unsigned b = 0; b < 256; b++) {
+        bool in = class(b) || (tolower(c) == 'w' && b == '_');
+        if (in != negate) {
+            set_add(set, b);
+        }
+    }
+}
+
+static struct frag parse_alt(struct parser *ps);
+
+/**
+ * Parse class function
+ * @brief This function parses a bracket expression after its '['.
+ */
+static struct frag parse_class(struct parser *ps) {
+    int s = add_state(ps, NFA_SET, -1, -1);
+    uint8_t set[32] = { 0 };
+    bool negate = *ps->p == '^';
+    if (negate) {
+        ps->p++;
+    }
+    bool first = true;
+    while (*ps->p != ']' || first) {
+        if (*ps->p == '\0') {
+            return fail(ps, "unterminated [");
+        }
+        unsigned char lo = *ps->p++;
+        first = false;
+        if (lo == '\\' && *ps->p != '\0') {
+            escape_set(set, *ps->p++);
+            continue;
+        }
+        unsigned char hi = lo;
+        if (ps->p[0] == '-' && ps->p[1] != ']' && ps->p[1] != '\0') {
+            hi = ps->p[1];
+            ps->p += 2;
+            if (hi < lo) {
+                return fail(ps, "invalid range in []");
+            }
+        }
+        for (unsigned c = lo; c <= hi; c++) {
+            set_add(set, c);
+        }
+    }
+    ps->p++;
+    for (unsigned c = 0; c < 256; c++) {
+        if (set_has(set, c) != negate) {
+            set_add(ps->states[s].set, c);
+        }
+    }
+    return single(ps, s, 0);
+}
+
+static struct frag parse_atom(struct parser *ps) {
+    unsigned char c = *ps->p++;
+    if (c == '(') {
+        struct frag f = parse_alt(ps);
+        if (f.start == -1) {
+            return f;
+        }
+        if (*ps->p != ')') {
+            return fail(ps, "missing )");
+        }
+        ps->p++;
+        return f;
+    }
+    if (c == '[') {
+        return parse_class(ps);
+    }
+    int s = add_state(ps, NFA_SET, -1, -1);
+    if (c == '.') {
+        memset(ps->states[s].set, 0xff, sizeof(ps->states[s].set));
+    } else if (c == '\\') {
+        if (*ps->p == '\0') {
+            return fail(ps, "trailing \\");
+        }
+        escape_set(ps->states[s].set, *ps->p++);
+    } else if (c == '*' || c == '+' || c == '?' || c == '{') {
+        return fail(ps, "repetition without operand");
+    } else {
+        set_add(ps->states[s].set, c);
+    }
+    return single(ps, s, 0);
+}
+
+static long parse_count(struct parser *ps) {
+    if (!isdigit((unsigned char) *ps->p)) {
+        return -1;
+    }
+    long n = 0;
+    while (isdigit((unsigned char) *ps->p) && n <= DFA_MAX_REPEAT) {
+        n = 10 * n + (*ps->p++ - '0');
+    }
+    return n;
+}
+
+/**
+ * Parse bound function
+ * @brief This function parses a bound {m}, {m,} or {m,n} and builds its copies of the atom that starts at atom.
+ */
+static struct frag parse_bound(struct parser *ps, struct frag f, const char *atom) {
+    long min = parse_count(ps), max = min;
+    bool unbounded = false;
+    if (*ps->p == ',') {
+        ps->p++;
+        unbounded = *ps->p == '}';
+        max = unbounded ? min : parse_count(ps);
+    }
+    if (min < 0 || max < min || *ps->p != '}' || max > DFA_MAX_REPEAT) {
+        return fail(ps, "invalid bound {m,n}");
+    }
+    const char *after = ++ps->p;
+
+    // the copies are parsed from the source of the atom again
+    struct frag result = epsilon(ps);
+    long copies = unbounded ? min + 1 : max;
+    for (long i = 0; i < copies; i++) {
+        struct frag copy = f;
+        if (i > 0) {
+            ps->p = atom;
+            copy = parse_atom(ps);
+            if (copy.start == -1) {
+                return copy;
+            }
+        }
+        if (i >= min) {
+            copy = unbounded ? star(ps, copy) : quest(ps, copy);
+        }
+        result = concat(ps, result, copy);
+    }
+    if (copies == 0) {
+        // {0} or {0,0}, the atom is never entered
+        free(f.holes);
+    }
+    ps->p = after;
+    return result;
+}
+
+static struct frag parse_repeat(struct parser *ps) {
+    const char *atom = ps->p;
+    struct frag f = parse_atom(ps);
+    bool repeated = false;
+    while (f.start != -1) {
+        if (*ps->p == '{' && repeated) {
+            return fail(ps, "bound after repetition");
+        }
+        repeated = true;
+        if (*ps->p == '*') {
+            f = star(ps, f);
+        } else if (*ps->p == '+') {
+            f = plus(ps, f);
+        } else if (*ps->p == '?') {
+            f = quest(ps, f);
+        } else if (*ps->p == '{') {
+            ps->p++;
+            f = parse_bound(ps, f, atom);
+            continue;
+        } else {
+            break;
+        }
+        ps->p++;
+    }
+    return f;
+}
+
+static struct frag parse_concat(struct parser *ps) {
+    struct frag f = epsilon(ps);
+    while (*ps->p != '\0' && *ps->p != '|' && *ps->p != ')') {
+        struct frag g = parse_repeat(ps);
+        if (g.start == -1) {
+            free(f.holes);
+            return g;
+        }
+        f = concat(ps, f, g);
+    }
+    return f;
+}
+
+static struct frag parse_alt(struct parser *ps) {
+    struct frag f = parse_concat(ps);
+    while (f.start != -1 && *ps->p == '|') {
+        ps->p++;
+        struct frag g = parse_concat(ps);
+        if (g.start == -1) {
+            free(f.holes);
+            return g;
+        }
+        int s = add_state(ps, NFA_SPLIT, f.start, g.start);
+        f.start = s;
+        join_holes(&f, &g);
+    }
+    return f;
+}
+
+/** A set of NFA states of the subset construction. */
+struct subset {
+    int words;
+    uint64_t *bits;
+};
+
+static void closure(const struct parser *ps, uint64_t *bits, int *stack) {
+    int top = 0;
+    for (int i = 0; i < ps->count; i++) {
+        if (bits[i / 64] >> (i % 64) & 1) {
+            stack[top++] = i;
+        }
+    }
+    while (top > 0) {
+        const struct nfa_state *s = &ps->states[stack[--top]];
+        int outs[2] = { -1, -1 };
+        if (s->type == NFA_SPLIT) {
+            outs[0] = s->out;
+            outs[1] = s->out1;
+        } else if (s->type == NFA_EPS) {
+            outs[0] = s->out;
+        }
+        for (int k = 0; k < 2; k++) {
+            int t = outs[k];
+            if (t != -1 && !(bits[t / 64] >> (t % 64) & 1)) {
+                bits[t / 64] |= (uint64_t) 1 << (t % 64);
+                stack[top++] = t;
+            }
+        }
+    }
+}
+
+static uint64_t hash_bits(const uint64_t *bits, int words) {
+    uint64_t h = 1469598103934665603ULL;
+    for (int i = 0; i < words; i++) {
+        h = (h ^ bits[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * Determinize function
+ * @brief This function builds the DFA of the NFA that starts at start by the subset construction.
+ * @return The DFA or NULL if it has more than DFA_MAX_STATES states
+ */
+static struct dfa *determinize(const struct parser *ps, int start) {
+    int words = (ps->count + 63) / 64;
+    uint64_t *sets = dfa_alloc(NULL, (size_t) DFA_MAX_STATES * words * sizeof(*sets));
+    int *table = dfa_alloc(NULL, 2 * DFA_MAX_STATES * sizeof(*table));
+    int *stack = dfa_alloc(NULL, ps->count * sizeof(*stack));
+    uint64_t *move = dfa_alloc(NULL, words * sizeof(*move));
+    for (int i = 0; i < 2 * DFA_MAX_STATES; i++) {
+        table[i] = -1;
+    }
+
+    struct dfa *dfa = dfa_alloc(NULL, sizeof(*dfa));
+    dfa->next = dfa_alloc(NULL, DFA_MAX_STATES * sizeof(*dfa->next));
+    dfa->accept = dfa_alloc(NULL, DFA_MAX_STATES * sizeof(*dfa->accept));
+    dfa->nstates = 0;
+    dfa->start = 0;
+
+    memset(move, 0, words * sizeof(*move));
+    move[start / 64] |= (uint64_t) 1 << (start % 64);
+    closure(ps, move, stack);
+    memcpy(sets, move, words * sizeof(*move));
+    table[hash_bits(move, words) % (2 * DFA_MAX_STATES)] = 0;
+    dfa->nstates = 1;
+
+    for (int d = 0; d < dfa->nstates; d++) {
+        const uint64_t *cur = sets + (size_t) d * words;
+        dfa->accept[d] = false;
+        for (int i = 0; i < ps->count; i++) {
+            if ((cur[i / 64] >> (i % 64) & 1) && ps->states[i].type == NFA_MATCH) {
+                dfa->accept[d] = true;
+            }
+        }
+        for (unsigned c = 0; c < 256; c++) {
+            bool empty = true;
+            memset(move, 0, words * sizeof(*move));
+            for (int i = 0; i < ps->count; i++) {
+                const struct nfa_state *s = &ps->states[i];
+                if ((cur[i / 64] >> (i % 64) & 1) && s->type == NFA_SET && set_has(s->set, c)) {
+                    move[s->out / 64] |= (uint64_t) 1 << (s->out % 64);
+                    empty = false;
+                }
+            }
+            if (empty) {
+                dfa->next[d][c] = -1;
+                continue;
+            }
+            closure(ps, move, stack);
+
+            size_t slot = hash_bits(move, words) % (2 * DFA_MAX_STATES);
+            while (table[slot] != -1 && memcmp(sets + (size_t) table[slot] * words, move, words * sizeof(*move)) != 0) {
+                slot = (slot + 1) % (2 * DFA_MAX_STATES);
+            }
+            if (table[slot] == -1) {
+                if (dfa->nstates == DFA_MAX_STATES) {
+                    free(sets);
+                    free(table);
+                    free(stack);
+                    free(move);
+                    dfa_free(dfa);
+                    return NULL;
+                }
+                table[slot] = dfa->nstates;
+                memcpy(sets + (size_t) dfa->nstates * words, move, words * sizeof(*move));
+                dfa->nstates += 1;
+            }
+            dfa->next[d][c] = table[slot];
+        }
+    }
+
+    free(sets);
+    free(table);
+    free(stack);
+    free(move);
+    dfa->next = dfa_alloc(dfa->next, dfa->nstates * sizeof(*dfa->next));
+    dfa->accept = dfa_alloc(dfa->accept, dfa->nstates * sizeof(*dfa->accept));
+    return dfa;
+}
+
+/**
+ * DFA compile function
+ * @brief This function compiles a pattern.
+ * @param pattern The pattern
+ * @param error Set to a description of the problem if the pattern cannot be compiled
+ * @return The automaton or NULL
+ */
+struct dfa *dfa_compile(const char *pattern, const char **error) {
+    struct parser ps = { .p = pattern, .error = NULL, .states = NULL, .count = 0, .cap = 0 };
+    if (*ps.p == '^') {
+        ps.p++;
+    }
+    struct frag f = parse_alt(&ps);
+    if (f.start != -1 && *ps.p != '\0') {
+        free(f.holes);
+        f = fail(&ps, "unmatched )");
+    }
+    if (f.start == -1) {
+        *error = ps.error;
+        free(ps.states);
+        return NULL;
+    }
+    int match = add_state(&ps, NFA_MATCH, -1, -1);
+    patch(&ps, &f, match);
+
+    struct dfa *dfa = determinize(&ps, f.start);
+    free(ps.states);
+    if (dfa == NULL) {
+        *error = "pattern needs too many states";
+    }
+    return dfa;
+}
+
+/**
+ * DFA match prefix function
+ * @brief This function tests if a prefix of s matches the pattern.
+ * @param dfa The automaton
+ * @param s The string
+ * @param len The length of the string
+ * @return true if it matches
+ */
+bool dfa_match_prefix(const struct dfa *dfa, const char *s, size_t len) {
+    int state = dfa->start;
+    for (size_t i = 0; i < len && !dfa->accept[state]; i++) {
+        state = dfa->next[state][(unsigned char) s[i]];
+        if (state == -1) {
+            return false;
+        }
+    }
+    return dfa->accept[state];
+}
+
+void dfa_free(struct dfa *dfa) {
+    free(dfa->next);
+    free(dfa->accept);
+    free(dfa);
+}
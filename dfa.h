@@ -0,0 +1,31 @@
+/**
+ * @file dfa.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Regular expressions compiled to a deterministic automaton, matched against the start of a line.
+ *
+ * The syntax is a subset of POSIX extended regular expressions: literals, '.', bracket expressions with ranges and
+ * negation, the escapes \d \D \s \S \w \W \t and '\' before any other character, grouping, '|', '*', '+', '?' and the
+ * bounds {m}, {m,} and {m,n}. A pattern is always anchored at the start of the line, a leading '^' is allowed.
+ **/
+
+#ifndef DFA_H
+#define DFA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Defines the maximum number of states of a compiled pattern. */
+#define DFA_MAX_STATES 4096
+
+/** Defines the maximum count of a bound {m,n}. */
+#define DFA_MAX_REPEAT 255
+
+struct dfa;
+
+struct dfa *dfa_compile(const char *pattern, const char **error);
+bool dfa_match_prefix(const struct dfa *dfa, const char *s, size_t len);
+void dfa_free(struct dfa *dfa);
+
+#endif
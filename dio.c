@@ -0,0 +1,189 @@
+/**
+ * @file dio.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Positional output streams, optionally written with O_DIRECT.
+ *
+ * A stream writes a file from a given offset with pwrite(), so several processes can write disjoint parts of one file.
+ * Direct streams write through a second, O_DIRECT opened descriptor of the same file from a buffer whose memory and
+ * file offsets are aligned to DIO_ALIGN. Only the unaligned head and tail of the written range go through the page cache.
+ * If the file system rejects O_DIRECT, the stream writes buffered and drops the written pages from the page cache.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "dio.h"
+
+/** Defines the alignment of direct writes (memory and file offsets). */
+#define DIO_ALIGN 4096
+
+/** Defines the buffer size of a stream (a multiple of DIO_ALIGN). */
+#define DIO_BUFFER (1024 * 1024)
+
+/** A positional stream, buf[i] belongs to the file offset base + i, only buf[lo, hi) holds data. */
+struct dio {
+    int fd;
+    int dfd;
+    bool direct;
+    char *buf;
+    off_t base;
+    size_t lo;
+    size_t hi;
+};
+
+static int pwrite_all(int fd, const char *buf, size_t len, off_t pos) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, buf, len, pos);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= n;
+        pos += n;
+    }
+    return 0;
+}
+
+/**
+ * Write buffered function
+ * @brief This function writes through the page cache, a direct stream then drops the written pages again.
+ */
+static int write_buffered(struct dio *d, size_t from, size_t to) {
+    if (pwrite_all(d->fd, d->buf + from, to - from, d->base + from) == -1) {
+        return -1;
+    }
+    if (d->direct && to - from >= DIO_ALIGN) {
+        sync_file_range(d->fd, d->base + from, to - from, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(d->fd, d->base + from, to - from, POSIX_FADV_DONTNEED);
+    }
+    return 0;
+}
+
+/**
+ * Write direct function
+ * @brief This function writes an aligned part of the buffer with O_DIRECT and falls back to buffered writes if it is rejected.
+ */
+static int write_direct(struct dio *d, size_t from, size_t to) {
+    if (d->dfd != -1) {
+        if (pwrite_all(d->dfd, d->buf + from, to - from, d->base + from) == 0) {
+            return 0;
+        }
+        if (errno != EINVAL) {
+            return -1;
+        }
+        close(d->dfd);
+        d->dfd = -1;
+    }
+    return write_buffered(d, from, to);
+}
+
+/**
+ * Flush function
+ * @brief This function writes the buffer: the unaligned head buffered, whole blocks direct and, at the end, the tail buffered.
+ * @param d The stream
+ * @param final true if the stream is closed, otherwise an incomplete last block is kept in the buffer
+ * @return 0 on success, -1 on error
+ */
+static int flush(struct dio *d, bool final) {
+    if (d->lo % DIO_ALIGN != 0) {
+        size_t head = d->lo - d->lo % DIO_ALIGN + DIO_ALIGN;
+        if (head > d->hi) {
+            head = d->hi;
+        }
+        if (write_buffered(d, d->lo, head) == -1) {
+            return -1;
+        }
+        d->lo = head;
+    }
+
+    size_t aligned = d->hi - d->hi % DIO_ALIGN;
+    if (aligned > d->lo && write_direct(d, d->lo, aligned) == -1) {
+        return -1;
+    }
+    if (final) {
+        return aligned < d->hi ? write_buffered(d, aligned > d->lo ? aligned : d->lo, d->hi) : 0;
+    }
+
+    memmove(d->buf, d->buf + aligned, d->hi - aligned);
+    d->base += aligned;
+    d->hi -= aligned;
+    d->lo = 0;
+    return 0;
+}
+
+static ssize_t dio_write(void *cookie, const char *data, size_t size) {
+    struct dio *d = cookie;
+    size_t done = 0;
+    while (done < size) {
+        size_t n = DIO_BUFFER - d->hi;
+        if (n > size - done) {
+            n = size - done;
+        }
+        memcpy(d->buf + d->hi, data + done, n);
+        d->hi += n;
+        done += n;
+        if (d->hi == DIO_BUFFER && flush(d, false) == -1) {
+            return -1;
+        }
+    }
+    return done;
+}
+
+static int dio_close(void *cookie) {
+    struct dio *d = cookie;
+    int ret = flush(d, true);
+    if (d->dfd != -1) {
+        close(d->dfd);
+    }
+    free(d->buf);
+    free(d);
+    return ret;
+}
+
+/**
+ * Open function
+ * @brief This function opens a stream that writes fd from offset pos on.
+ * @details The descriptor itself is neither moved nor closed by the stream.
+ * @param fd The file descriptor of a regular file
+ * @param pos The file offset of the first written byte
+ * @param direct true if the stream should bypass the page cache with O_DIRECT
+ * @return The stream or NULL
+ */
+FILE *dio_open(int fd, off_t pos, bool direct) {
+    struct dio *d = malloc(sizeof(*d));
+    if (d == NULL) {
+        return NULL;
+    }
+    if (posix_memalign((void **) &d->buf, DIO_ALIGN, DIO_BUFFER) != 0) {
+        free(d);
+        return NULL;
+    }
+    d->fd = fd;
+    d->direct = direct;
+    d->dfd = -1;
+    d->base = pos - pos % DIO_ALIGN;
+    d->lo = d->hi = pos % DIO_ALIGN;
+
+    if (direct) {
+        // a separate open file description, so O_DIRECT does not affect the buffered writes of the head and tail
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+        d->dfd = open(path, O_WRONLY | O_DIRECT | O_CLOEXEC);
+    }
+
+    cookie_io_functions_t io = { .read = NULL, .write = dio_write, .seek = NULL, .close = dio_close };
+    FILE *stream = fopencookie(d, "w", io);
+    if (stream == NULL) {
+        dio_close(d);
+        return NULL;
+    }
+    return stream;
+}
@@ -0,0 +1,18 @@
+/**
+ * @file dio.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Positional output streams, optionally written with O_DIRECT.
+ **/
+
+#ifndef DIO_H
+#define DIO_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+FILE *dio_open(int fd, off_t pos, bool direct);
+
+#endif
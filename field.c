@@ -0,0 +1,192 @@
+/**
+ * @file field.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Fields of a record (--field-separator=CHAR).
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "field.h"
+
+/** The separator, -1 for runs of blanks. */
+static int separator = -1;
+
+/** The projected fields (numbered from 1) and the list they were given as, none without a projection. */
+static size_t *projection = NULL;
+static size_t projected = 0, max_projected = 0;
+static const char *projection_list = NULL;
+
+static void *field_alloc(void *p, size_t size) {
+    p = realloc(p, size > 0 ? size : 1);
+    if (p == NULL) {
+        fprintf(stderr, "field: Unable to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+/**
+ * Field set separator function
+ * @brief This function sets the separator, a single byte or "\t".
+ * @return false if the argument is not a separator
+ */
+bool field_set_separator(const char *arg) {
+    if (strcmp(arg, "\\t") == 0) {
+        separator = '\t';
+    } else if (strlen(arg) == 1 && arg[0] != '\n') {
+        separator = (unsigned char) arg[0];
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Field separator function
+ * @return The separator, -1 for runs of blanks
+ */
+int field_separator(void) {
+    return separator;
+}
+
+static bool blank(char c) {
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+/**
+ * Field split function
+ * @brief This function finds the first fields of a record.
+ * @param rec The record without its newline
+ * @param len The length of the record
+ * @param fields Set to the fields, fields[i] is field i + 1
+ * @param max The number of fields wanted
+ * @return The number of fields found, at most max
+ */
+size_t field_split(const char *rec, size_t len, struct field *fields, size_t max) {
+    size_t n = 0, i = 0;
+    if (separator != -1) {
+        while (n < max) {
+            const char *end = memchr(rec + i, separator, len - i);
+            size_t stop = end != NULL ? (size_t) (end - rec) : len;
+            fields[n++] = (struct field) { .start = i, .len = stop - i };
+            if (end == NULL) {
+                break;
+            }
+            i = stop + 1;
+        }
+        return n;
+    }
+    while (n < max) {
+        while (i < len && blank(rec[i])) {
+            i++;
+        }
+        if (i == len) {
+            break;
+        }
+        size_t start = i;
+        while (i < len && !blank(rec[i])) {
+            i++;
+        }
+        fields[n++] = (struct field) { .start = start, .len = i - start };
+    }
+    return n;
+}
+
+/**
+ * Field set projection function
+ * @brief This function sets the fields that are kept, a comma separated list of field numbers.
+ * @return false if the list is invalid
+ */
+bool field_set_projection(const char *list) {
+    const char *p = list;
+    projected = max_projected = 0;
+    do {
+        char *end;
+        errno = 0;
+        unsigned long n = strtoul(p, &end, 10);
+        if (end == p || *p == '-' || *p == '+' || errno != 0 || n < 1 || n > 65535 ||
+            (*end != ',' && *end != '\0') || (*end == ',' && end[1] == '\0')) {
+            return false;
+        }
+        projection = field_alloc(projection, (projected + 1) * sizeof(*projection));
+        projection[projected++] = n;
+        max_projected = n > max_projected ? n : max_projected;
+        p = *end == ',' ? end + 1 : end;
+    } while (*p != '\0');
+    projection_list = list;
+    return true;
+}
+
+bool field_projecting(void) {
+    return projected > 0;
+}
+
+/**
+ * Field describe projection function
+ * @return The projected fields as they were given, "" without a projection
+ */
+const char *field_describe_projection(void) {
+    return projection_list != NULL ? projection_list : "";
+}
+
+/**
+ * Field project function
+ * @brief This function keeps the projected fields of a record.
+ * @param rec The record without its newline
+ * @param len The length of the record
+ * @param out_len Set to the length of the projected record
+ * @return The projected record in a static buffer that is valid until the next call
+ */
+const char *field_project(const char *rec, size_t len, size_t *out_len) {
+    static struct field *fields = NULL;
+    static char *buf = NULL;
+    static size_t size = 0;
+    if (fields == NULL) {
+        fields = field_alloc(NULL, max_projected * sizeof(*fields));
+    }
+    if (size < len + projected + 2) {
+        size = 2 * (len + projected + 2);
+        buf = field_alloc(buf, size);
+    }
+
+    size_t found = field_split(rec, len, fields, max_projected);
+    char join = separator != -1 ? (char) separator : ' ';
+    size_t o = 0;
+    for (size_t i = 0; i < projected; i++) {
+        if (i > 0) {
+            buf[o++] = join;
+        }
+        if (projection[i] <= found) {
+            const struct field *f = &fields[projection[i] - 1];
+            memcpy(buf + o, rec + f->start, f->len);
+            o += f->len;
+        }
+    }
+    *out_len = o;
+    return buf;
+}
+
+/**
+ * Field project line function
+ * @brief This function replaces a line by its projection.
+ * @param line The line, ending with a newline, it is freed
+ * @param len The length of the line, set to the length of the projected line
+ * @return The projected line, ending with a newline
+ */
+char *field_project_line(char *line, size_t *len) {
+    size_t plen;
+    const char *p = field_project(line, *len - 1, &plen);
+    if (plen + 2 > *len + 1) {
+        line = field_alloc(line, plen + 2);
+    }
+    memcpy(line, p, plen);
+    line[plen] = '\n';
+    line[plen + 1] = '\0';
+    *len = plen + 1;
+    return line;
+}
@@ -0,0 +1,37 @@
+/**
+ * @file field.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Fields of a record (--field-separator=CHAR).
+ *
+ * By default fields are separated by runs of blanks (space, tab, newline) and blanks at the start of the record are
+ * skipped, like awk splits them. With a separator every occurrence of it ends a field, so fields may be empty.
+ * Fields are numbered from 1.
+ *
+ * A projection (--output-fields=LIST) keeps the listed fields of every record, in the order of the list, joined by the
+ * separator (a space by default). A field the record does not have is kept empty.
+ **/
+
+#ifndef FIELD_H
+#define FIELD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** A field: its start and length in the record. */
+struct field {
+    size_t start, len;
+};
+
+bool field_set_separator(const char *arg);
+int field_separator(void);
+size_t field_split(const char *rec, size_t len, struct field *fields, size_t max);
+
+bool field_set_projection(const char *list);
+bool field_projecting(void);
+const char *field_describe_projection(void);
+const char *field_project(const char *rec, size_t len, size_t *out_len);
+char *field_project_line(char *line, size_t *len);
+
+#endif
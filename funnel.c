@@ -0,0 +1,118 @@
+/**
+ * @file funnel.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Cache-oblivious lazy funnelsort of a line array (--engine=funnel).
+ *
+ * The k-funnel is a complete binary tree over the k sorted parts (padded with empty parts to a power of two), numbered
+ * like a heap. A tree of height h is cut at its middle level into a top tree of height ceil(h/2) and 2^ceil(h/2) bottom
+ * trees of height floor(h/2), each bottom root gets an output buffer of k^(3/2) lines (k = 2^h), capped at the lines
+ * below it, and both parts are cut the same way. The buffers are placed in one allocation in that recursive order.
+ *
+ * The funnel is lazy: a node is filled only when its parent finds its buffer empty, and it then merges from its
+ * children until its own buffer is full or both children are exhausted, filling a child whenever that one runs empty.
+ * The root fills the output array.
+ *
+ * The kernels are instantiated from funnel_kernel.h once per line layout, like the ones of memsort.c.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "funnel.h"
+#include "longrec.h"
+
+/** Defines the number of lines up to which a part is sorted by insertion. */
+#define FUNNEL_BASE 16
+
+/** A node of the funnel and its output buffer; the leaves are the sorted parts themselves. */
+struct node {
+    char **buf;
+    size_t head, tail, cap;
+    size_t below;
+    bool exhausted;
+};
+
+/** A k-funnel over the parts of one merge. */
+struct funnel {
+    struct node *nodes;
+    size_t leaves;
+    size_t arena_size;
+    char **arena;
+};
+
+/** The number of comparisons of the current sort. */
+static uint64_t comparisons;
+
+static void *funnel_alloc(size_t size) {
+    void *p = malloc(size);
+    if (p == NULL) {
+        fprintf(stderr, "funnel: Unable to allocate memory for lines\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+/**
+ * Layout function
+ * @brief This function sizes the buffers of the subtree of height h rooted at r and places them in recursive order.
+ * @details With place set, the buffers are pointed into the arena, otherwise only the arena size is counted.
+ */
+static void layout(struct funnel *f, size_t r, unsigned h, bool place) {
+    if (h <= 1) {
+        return;
+    }
+    unsigned top = (h + 1) / 2, bottom = h - top;
+    layout(f, r, top, place);
+
+    // k^(3/2) for k = 2^h leaves
+    size_t size = (size_t) 1 << (3 * h / 2);
+    if (h % 2 == 1) {
+        size += size * 41 / 100;
+    }
+    size_t first = r << top;
+    for (size_t b = first; b < first + ((size_t) 1 << top); b++) {
+        struct node *v = &f->nodes[b];
+        v->cap = size < v->below ? size : v->below;
+        if (place) {
+            v->buf = f->arena + f->arena_size;
+        }
+        f->arena_size += v->cap;
+        layout(f, b, bottom, place);
+    }
+}
+
+#define KERNEL(name) name##_plain
+#define KERNEL_CMP(a, b) (comparisons++, strcmp(a, b))
+#include "funnel_kernel.h"
+
+#define KERNEL(name) name##_ref
+#define KERNEL_CMP(a, b) (comparisons++, longrec_cmp(a, b))
+#include "funnel_kernel.h"
+
+/**
+ * Funnelsort function
+ * @brief This function sorts a line array in memory in the order of longrec_cmp().
+ * @param lines The lines
+ * @param numlines The number of lines
+ * @return The number of comparisons
+ */
+uint64_t funnelsort(char **lines, size_t numlines) {
+    comparisons = 0;
+    if (numlines <= FUNNEL_BASE) {
+        insertion_sort_ref(lines, numlines);
+        return comparisons;
+    }
+    char **tmp = funnel_alloc(numlines * sizeof(*tmp));
+    if (longrec_fd() == -1) {
+        // without a spill file there are no references
+        sort_plain(lines, tmp, numlines);
+    } else {
+        sort_ref(lines, tmp, numlines);
+    }
+    free(tmp);
+    return comparisons;
+}
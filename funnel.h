@@ -0,0 +1,21 @@
+/**
+ * @file funnel.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Cache-oblivious lazy funnelsort of a line array (--engine=funnel).
+ *
+ * Funnelsort splits its input into n^(1/3) parts, sorts them recursively and merges them with a k-funnel: a binary
+ * tree of mergers whose buffers are sized and laid out recursively (van Emde Boas order), so every level of the memory
+ * hierarchy sees an optimal number of misses without the sort knowing any cache size.
+ **/
+
+#ifndef FUNNEL_H
+#define FUNNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint64_t funnelsort(char **lines, size_t numlines);
+
+#endif
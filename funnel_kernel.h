@@ -0,0 +1,132 @@
+/**
+ * @file funnel_kernel.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Template of the leaf sort and funnel merge kernels of funnelsort(), included once per line layout.
+ *
+ * Before every inclusion funnel.c defines KERNEL(name), the name of a function of this instance, and
+ * KERNEL_CMP(a, b), the order of two lines; both are undefined at the end.
+ **/
+
+static void KERNEL(insertion_sort)(char **lines, size_t n) {
+    for (size_t i = 1; i < n; i++) {
+        char *line = lines[i];
+        size_t j = i;
+        while (j > 0 && KERNEL_CMP(lines[j - 1], line) > 0) {
+            lines[j] = lines[j - 1];
+            j--;
+        }
+        lines[j] = line;
+    }
+}
+
+/**
+ * Fill function
+ * @brief This function refills the empty buffer of an inner node from its children.
+ */
+static void KERNEL(fill)(struct funnel *f, size_t v) {
+    struct node *out = &f->nodes[v];
+    struct node *l = &f->nodes[2 * v], *r = &f->nodes[2 * v + 1];
+    out->head = out->tail = 0;
+    while (out->tail < out->cap) {
+        if (l->head == l->tail && !l->exhausted) {
+            KERNEL(fill)(f, 2 * v);
+        }
+        if (r->head == r->tail && !r->exhausted) {
+            KERNEL(fill)(f, 2 * v + 1);
+        }
+        bool has_l = l->head < l->tail, has_r = r->head < r->tail;
+        if (!has_l && !has_r) {
+            out->exhausted = true;
+            return;
+        }
+        if (!has_r || (has_l && KERNEL_CMP(l->buf[l->head], r->buf[r->head]) <= 0)) {
+            size_t n = out->cap - out->tail;
+            // the rest of a lone child is copied at once
+            if (!has_r && r->exhausted) {
+                n = n < l->tail - l->head ? n : l->tail - l->head;
+                memcpy(out->buf + out->tail, l->buf + l->head, n * sizeof(*out->buf));
+                out->tail += n;
+                l->head += n;
+            } else {
+                out->buf[out->tail++] = l->buf[l->head++];
+            }
+        } else if (!has_l && l->exhausted) {
+            size_t n = out->cap - out->tail;
+            n = n < r->tail - r->head ? n : r->tail - r->head;
+            memcpy(out->buf + out->tail, r->buf + r->head, n * sizeof(*out->buf));
+            out->tail += n;
+            r->head += n;
+        } else {
+            out->buf[out->tail++] = r->buf[r->head++];
+        }
+    }
+    if (l->exhausted && r->exhausted && l->head == l->tail && r->head == r->tail) {
+        out->exhausted = true;
+    }
+}
+
+/**
+ * Merge function
+ * @brief This function merges k sorted parts of equal length (the last may be shorter) of src into dst with a k-funnel.
+ */
+static void KERNEL(merge)(char **src, char **dst, size_t numlines, size_t part, size_t k) {
+    struct funnel f = { .leaves = 1, .arena_size = 0, .arena = NULL };
+    unsigned height = 0;
+    while (f.leaves < k) {
+        f.leaves *= 2;
+        height += 1;
+    }
+    f.nodes = funnel_alloc(2 * f.leaves * sizeof(*f.nodes));
+    for (size_t i = 0; i < f.leaves; i++) {
+        struct node *leaf = &f.nodes[f.leaves + i];
+        size_t start = i * part < numlines ? i * part : numlines;
+        size_t end = start + part < numlines ? start + part : numlines;
+        *leaf = (struct node) { .buf = src + start, .head = 0, .tail = end - start, .cap = end - start,
+                                .below = end - start, .exhausted = true };
+    }
+    for (size_t v = f.leaves - 1; v >= 1; v--) {
+        f.nodes[v] = (struct node) { .buf = NULL, .head = 0, .tail = 0, .cap = 0,
+                                     .below = f.nodes[2 * v].below + f.nodes[2 * v + 1].below };
+        // a subtree over padding parts is never filled
+        f.nodes[v].exhausted = f.nodes[v].below == 0;
+    }
+
+    layout(&f, 1, height, false);
+    f.arena = funnel_alloc((f.arena_size > 0 ? f.arena_size : 1) * sizeof(*f.arena));
+    f.arena_size = 0;
+    layout(&f, 1, height, true);
+
+    f.nodes[1].buf = dst;
+    f.nodes[1].cap = numlines;
+    KERNEL(fill)(&f, 1);
+
+    free(f.arena);
+    free(f.nodes);
+}
+
+/**
+ * Sort function
+ * @brief This function sorts lines recursively, tmp is scratch space for as many lines.
+ */
+static void KERNEL(sort)(char **lines, char **tmp, size_t numlines) {
+    if (numlines <= FUNNEL_BASE) {
+        KERNEL(insertion_sort)(lines, numlines);
+        return;
+    }
+    size_t k = 1;
+    while (k * k * k < numlines) {
+        k++;
+    }
+    size_t part = (numlines + k - 1) / k;
+    for (size_t start = 0; start < numlines; start += part) {
+        size_t n = numlines - start < part ? numlines - start : part;
+        KERNEL(sort)(lines + start, tmp + start, n);
+    }
+    KERNEL(merge)(lines, tmp, numlines, part, (numlines + part - 1) / part);
+    memcpy(lines, tmp, numlines * sizeof(*lines));
+}
+
+#undef KERNEL
+#undef KERNEL_CMP
@@ -0,0 +1,262 @@
+/**
+ * @file index.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Sparse block index of a sorted output.
+ *
+ * The root adds every line it prints to the index, one entry is written whenever a line starts in a new block.
+ * The lookup mode maps the output and the index and answers point and range queries with a binary search
+ * over the entry table followed by a scan of the blocks in range.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "index.h"
+#include "line.h"
+
+#define INDEX_MAGIC "FSIX"
+#define INDEX_END_MAGIC "FSIXEND"
+#define INDEX_VERSION 1
+#define HEADER_SIZE 16
+#define FOOTER_SIZE 24
+
+/**
+ * Index error function
+ * @brief This function writes an index error to stderr and exits with an EXIT_FAILURE status
+ * @param msg The message
+ */
+static void index_error(const char *msg) {
+    fprintf(stderr, "index: %s: %s\n", msg, strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+static void write_bytes(struct sparse_index *sidx, const void *data, size_t len) {
+    if (fwrite(data, 1, len, sidx->file) != len) {
+        index_error("could not write index");
+    }
+}
+
+static void write_u32(struct sparse_index *sidx, uint32_t v) {
+    write_bytes(sidx, &v, sizeof(v));
+}
+
+static void write_u64(struct sparse_index *sidx, uint64_t v) {
+    write_bytes(sidx, &v, sizeof(v));
+}
+
+/**
+ * Index create function
+ * @brief This function creates the index file and writes its header.
+ * @param path The path of the index file
+ * @param block The block size in bytes
+ * @return The index
+ */
+struct sparse_index *index_create(const char *path, off_t block) {
+    struct sparse_index *sidx = calloc(1, sizeof(*sidx));
+    if (sidx == NULL) {
+        index_error("could not allocate index");
+    }
+    if ((sidx->file = fopen(path, "we")) == NULL) {
+        index_error("could not create index");
+    }
+    sidx->block = block;
+
+    write_bytes(sidx, INDEX_MAGIC, 4);
+    write_u32(sidx, INDEX_VERSION);
+    write_u32(sidx, (uint32_t) block);
+    write_u32(sidx, 0);
+    return sidx;
+}
+
+/**
+ * Index add function
+ * @brief This function accounts one printed line and writes an entry if the line is the first one in its block.
+ * @param sidx The index
+ * @param line The line without its newline
+ * @param len The length of the line
+ */
+void index_add(struct sparse_index *sidx, const char *line, size_t len) {
+    if (sidx->offset >= sidx->next) {
+        if (sidx->count == sidx->cap) {
+            sidx->cap = sidx->cap ? sidx->cap * 2 : 256;
+            uint64_t *grown = realloc(sidx->positions, sidx->cap * sizeof(*grown));
+            if (grown == NULL) {
+                index_error("could not grow index");
+            }
+            sidx->positions = grown;
+        }
+        long pos = ftell(sidx->file);
+        if (pos == -1) {
+            index_error("could not tell index position");
+        }
+        sidx->positions[sidx->count++] = (uint64_t) pos;
+
+        write_u64(sidx, (uint64_t) sidx->offset);
+        write_u32(sidx, (uint32_t) len);
+        write_bytes(sidx, line, len);
+        sidx->next = (sidx->offset / sidx->block + 1) * sidx->block;
+    }
+    sidx->offset += len + 1;
+}
+
+/**
+ * Index scan function
+ * @brief This function adds every line of an already sorted file to the index.
+ * @param sidx The index
+ * @param fd The file descriptor of the sorted file
+ */
+void index_scan_fd(struct sparse_index *sidx, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        index_error("could not stat output");
+    }
+    if (st.st_size == 0) {
+        return;
+    }
+
+    char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        index_error("could not map output");
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    char *p = data, *end = data + st.st_size;
+    while (p < end) {
+        char *nl = memchr(p, '\n', end - p);
+        size_t len = nl ? (size_t) (nl - p) : (size_t) (end - p);
+        index_add(sidx, p, len);
+        p += len + 1;
+    }
+    munmap(data, st.st_size);
+}
+
+/**
+ * Index close function
+ * @brief This function writes the entry table and the footer and frees the index.
+ * @param sidx The index
+ */
+void index_close(struct sparse_index *sidx) {
+    long table = ftell(sidx->file);
+    if (table == -1) {
+        index_error("could not tell index position");
+    }
+    write_bytes(sidx, sidx->positions, sidx->count * sizeof(*sidx->positions));
+    write_u64(sidx, (uint64_t) table);
+    write_u64(sidx, sidx->count);
+    write_bytes(sidx, INDEX_END_MAGIC, 8);
+    if (fclose(sidx->file) == EOF) {
+        index_error("could not close index");
+    }
+    free(sidx->positions);
+    free(sidx);
+}
+
+/** A read-only mapping of a whole file. */
+struct mapping {
+    const char *data;
+    size_t size;
+};
+
+static void map_file(const char *path, struct mapping *map) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        index_error(path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        index_error(path);
+    }
+    map->size = st.st_size;
+    map->data = NULL;
+    if (map->size > 0) {
+        map->data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map->data == MAP_FAILED) {
+            index_error(path);
+        }
+    }
+    close(fd);
+}
+
+static uint64_t load_u64(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t load_u32(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * Index lookup main function
+ * @brief This function implements "forksort lookup OUTPUT INDEX FIRST [LAST]".
+ * @details Prints every line of OUTPUT that equals FIRST or, if LAST is given, lies in [FIRST, LAST].
+ * The entry table is binary searched for the last block that starts with a line smaller than FIRST,
+ * so only the blocks in range are touched.
+ * @param argc The argument count, argv[0] is "lookup"
+ * @param argv The arguments
+ * @return The exit status
+ */
+int index_lookup_main(int argc, char *argv[]) {
+    if (argc != 4 && argc != 5) {
+        fprintf(stderr, "USAGE: forksort lookup OUTPUT INDEX FIRST [LAST]\n");
+        return EXIT_FAILURE;
+    }
+    const char *first = argv[3];
+    const char *last = argc == 5 ? argv[4] : argv[3];
+    size_t first_len = strlen(first), last_len = strlen(last);
+
+    struct mapping output, sidx;
+    map_file(argv[1], &output);
+    map_file(argv[2], &sidx);
+    if (sidx.size < HEADER_SIZE + FOOTER_SIZE || memcmp(sidx.data, INDEX_MAGIC, 4) != 0
+            || load_u32(sidx.data + 4) != INDEX_VERSION
+            || memcmp(sidx.data + sidx.size - 8, INDEX_END_MAGIC, 8) != 0) {
+        fprintf(stderr, "index: %s is not a forksort index\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    const char *table = sidx.data + load_u64(sidx.data + sidx.size - FOOTER_SIZE);
+    uint64_t count = load_u64(sidx.data + sidx.size - FOOTER_SIZE + 8);
+
+    // find the last entry whose key is smaller than first
+    uint64_t lo = 0, hi = count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        const char *entry = sidx.data + load_u64(table + mid * 8);
+        if (cmp_line(entry + 12, load_u32(entry + 8), first, first_len) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    uint64_t start = lo == 0 ? 0 : load_u64(sidx.data + load_u64(table + (lo - 1) * 8));
+    if (start > output.size) {
+        fprintf(stderr, "index: %s does not belong to %s\n", argv[2], argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    const char *p = output.data + start, *end = output.data + output.size;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', end - p);
+        size_t len = nl ? (size_t) (nl - p) : (size_t) (end - p);
+        if (cmp_line(p, len, last, last_len) > 0) {
+            break;
+        }
+        if (cmp_line(p, len, first, first_len) >= 0) {
+            fwrite(p, 1, len, stdout);
+            putchar('\n');
+        }
+        p += len + 1;
+    }
+    return fflush(stdout) == EOF ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,47 @@
+/**
+ * @file index.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Sparse block index of a sorted output.
+ *
+ * The index holds the first line and its byte offset of every block of the output, so a lookup
+ * only has to binary search the index and scan a single block of the output.
+ *
+ * File layout (all integers little endian):
+ *   header   "FSIX", u32 version, u32 block size, u32 reserved
+ *   entries  u64 offset, u32 key length, key bytes      (one per block, in output order)
+ *   table    u64 file position of every entry
+ *   footer   u64 table position, u64 entry count, "FSIXEND\0"
+ **/
+
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/** Defines the default block size of the index (64 KiB). */
+#define INDEX_DEFAULT_BLOCK (64 * 1024)
+
+/** An index that is being written. */
+struct sparse_index {
+    FILE *file;
+    off_t block;
+    off_t offset;
+    off_t next;
+    uint64_t *positions;
+    size_t count;
+    size_t cap;
+};
+
+struct sparse_index *index_create(const char *path, off_t block);
+void index_add(struct sparse_index *sidx, const char *line, size_t len);
+void index_scan_fd(struct sparse_index *sidx, int fd);
+void index_close(struct sparse_index *sidx);
+
+int index_lookup_main(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,288 @@
+/**
+ * @file inplace.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief In-place sorting of fixed-size binary records in a memory-mapped file.
+ *
+ * The file is mapped shared, so forked workers sort disjoint parts of it directly in the mapping (in-place samplesort):
+ * 1. splitters are taken from a sorted sample of the records,
+ * 2. the workers count how many records of their stripe fall into each bucket,
+ * 3. the records are permuted into their buckets by swapping (American flag permutation),
+ * 4. every worker sorts one bucket in place (introsort).
+ * Besides the sample and the counters no memory proportional to the input is needed and nothing passes a pipe.
+ *
+ * The steps are instantiated from inplace_kernel.h per record layout (4, 8 and 16 byte keys compared as big-endian
+ * words, any other size with memcmp()), and one instance is selected per file, so no loop calls through a pointer.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "inplace.h"
+
+/** Defines the number of sampled records per bucket. */
+#define OVERSAMPLE 32
+
+/** Defines the number of records below which the file is sorted by a single process. */
+#define PARALLEL_MIN 4096
+
+/** Defines the number of records below which insertion sort is used. */
+#define INSERTION_MAX 16
+
+struct kernel;
+
+/** The mapped file and the state shared with the workers. */
+struct ctx {
+    char *base;
+    size_t n;
+    size_t size;
+    int jobs;
+    size_t buckets;
+    char *splitters;
+    size_t *counts;
+    size_t *starts;
+    const struct kernel *kernel;
+};
+
+/** The sort and partition kernels of one record layout, see inplace_kernel.h. */
+struct kernel {
+    void (*sort_all)(const struct ctx *ctx, char *base, size_t n);
+    void (*count_stripe)(struct ctx *ctx, int worker);
+    void (*sort_bucket)(struct ctx *ctx, int worker);
+    void (*permute)(struct ctx *ctx);
+};
+
+/**
+ * In-place error function
+ * @brief This function writes an error of the in-place engine to stderr and exits with an EXIT_FAILURE status
+ * @param msg The message
+ */
+static void inplace_error(const char *msg) {
+    fprintf(stderr, "in-place: %s: %s\n", msg, strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+static inline char *base_rec(const struct ctx *ctx, char *base, size_t i) {
+    return base + i * ctx->size;
+}
+
+static inline uint32_t load_be32(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static inline uint64_t load_be64(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+/*
+ * Big-endian loads order integers like memcmp() orders their bytes, so the fixed layouts compare one or two words
+ * instead of calling memcmp().
+ */
+static inline int cmp_u32(const char *a, const char *b) {
+    uint32_t x = load_be32(a), y = load_be32(b);
+    return (x > y) - (x < y);
+}
+
+static inline int cmp_u64(const char *a, const char *b) {
+    uint64_t x = load_be64(a), y = load_be64(b);
+    return (x > y) - (x < y);
+}
+
+static inline int cmp_u128(const char *a, const char *b) {
+    int c = cmp_u64(a, b);
+    return c != 0 ? c : cmp_u64(a + 8, b + 8);
+}
+
+#define KERNEL(name) name##_u32
+#define KERNEL_SIZE(ctx) ((size_t) 4)
+#define KERNEL_CMP(ctx, a, b) cmp_u32(a, b)
+#include "inplace_kernel.h"
+
+#define KERNEL(name) name##_u64
+#define KERNEL_SIZE(ctx) ((size_t) 8)
+#define KERNEL_CMP(ctx, a, b) cmp_u64(a, b)
+#include "inplace_kernel.h"
+
+#define KERNEL(name) name##_u128
+#define KERNEL_SIZE(ctx) ((size_t) 16)
+#define KERNEL_CMP(ctx, a, b) cmp_u128(a, b)
+#include "inplace_kernel.h"
+
+#define KERNEL(name) name##_bytes
+#define KERNEL_SIZE(ctx) ((ctx)->size)
+#define KERNEL_CMP(ctx, a, b) memcmp(a, b, (ctx)->size)
+#include "inplace_kernel.h"
+
+/**
+ * Select kernel function
+ * @brief This function picks the kernels of a record size: whole words for 4, 8 and 16 bytes, memcmp() otherwise.
+ */
+static const struct kernel *select_kernel(size_t record_size) {
+    switch (record_size) {
+        case 4:
+            return &kernel_u32;
+        case 8:
+            return &kernel_u64;
+        case 16:
+            return &kernel_u128;
+        default:
+            return &kernel_bytes;
+    }
+}
+
+/**
+ * Run workers function
+ * @brief This function forks one worker per job, runs fn in each and waits for all of them.
+ * @param ctx The context, shared memory in it is visible to the parent afterwards
+ * @param fn The function run by every worker
+ */
+static void run_workers(struct ctx *ctx, void (*fn)(struct ctx *, int)) {
+    fflush(NULL);
+    for (int w = 0; w < ctx->jobs; w++) {
+        switch (fork()) {
+            case -1:
+                inplace_error("fork failed");
+            case 0:
+                fn(ctx, w);
+                _exit(EXIT_SUCCESS);
+            default:
+                break;
+        }
+    }
+
+    bool failed = false;
+    int status;
+    for (int w = 0; w < ctx->jobs; w++) {
+        if (wait(&status) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            failed = true;
+        }
+    }
+    if (failed) {
+        fprintf(stderr, "in-place: a worker failed, the file is left partially sorted\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Choose splitters function
+ * @brief This function sorts an evenly spaced sample of the records and takes buckets - 1 equidistant splitters from it.
+ */
+static void choose_splitters(struct ctx *ctx) {
+    size_t samples = ctx->buckets * OVERSAMPLE;
+    char *sample = malloc(samples * ctx->size);
+    if (sample == NULL) {
+        inplace_error("could not allocate sample");
+    }
+    for (size_t i = 0; i < samples; i++) {
+        memcpy(base_rec(ctx, sample, i), base_rec(ctx, ctx->base, i * (ctx->n / samples)), ctx->size);
+    }
+    ctx->kernel->sort_all(ctx, sample, samples);
+    for (size_t b = 1; b < ctx->buckets; b++) {
+        memcpy(base_rec(ctx, ctx->splitters, b - 1), base_rec(ctx, sample, b * OVERSAMPLE), ctx->size);
+    }
+    free(sample);
+}
+
+/**
+ * In-place sort records function
+ * @brief This function sorts fixed-size records in memory, records are compared bytewise.
+ * @details The workers sort the records in place, so with more than one job base must be a shared mapping.
+ * @param base The first record
+ * @param n The number of records
+ * @param record_size The size of a record in bytes
+ * @param jobs The number of worker processes
+ */
+void inplace_sort_records(char *base, size_t n, size_t record_size, int jobs) {
+    struct ctx ctx = { .base = base, .n = n, .size = record_size, .jobs = jobs > 0 ? jobs : 1,
+                       .kernel = select_kernel(record_size) };
+    if (ctx.n < 2) {
+        return;
+    }
+    if (ctx.jobs == 1 || ctx.n < PARALLEL_MIN) {
+        ctx.kernel->sort_all(&ctx, ctx.base, ctx.n);
+    } else {
+        ctx.buckets = ctx.jobs;
+        size_t shared = (ctx.jobs * ctx.buckets + ctx.buckets + 1) * sizeof(size_t);
+        ctx.counts = mmap(NULL, shared, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        ctx.splitters = malloc((ctx.buckets - 1) * record_size);
+        if (ctx.counts == MAP_FAILED || ctx.splitters == NULL) {
+            inplace_error("could not allocate buckets");
+        }
+        ctx.starts = ctx.counts + ctx.jobs * ctx.buckets;
+
+        choose_splitters(&ctx);
+        run_workers(&ctx, ctx.kernel->count_stripe);
+
+        ctx.starts[0] = 0;
+        for (size_t b = 0; b < ctx.buckets; b++) {
+            size_t count = 0;
+            for (int w = 0; w < ctx.jobs; w++) {
+                count += ctx.counts[w * ctx.buckets + b];
+            }
+            ctx.starts[b + 1] = ctx.starts[b] + count;
+        }
+
+        ctx.kernel->permute(&ctx);
+        run_workers(&ctx, ctx.kernel->sort_bucket);
+
+        free(ctx.splitters);
+        munmap(ctx.counts, shared);
+    }
+}
+
+/**
+ * In-place sort function
+ * @brief This function sorts the fixed-size records of a file in place, records are compared bytewise.
+ * @param path The file
+ * @param record_size The size of a record in bytes
+ * @param jobs The number of worker processes
+ */
+void inplace_sort(const char *path, size_t record_size, int jobs) {
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        inplace_error(path);
+    }
+    if (st.st_size % record_size != 0) {
+        fprintf(stderr, "in-place: the size of %s is not a multiple of the record size\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t n = st.st_size / record_size;
+    if (n < 2) {
+        close(fd);
+        return;
+    }
+    char *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        inplace_error("could not map file");
+    }
+    close(fd);
+
+    inplace_sort_records(base, n, record_size, jobs);
+
+    if (msync(base, st.st_size, MS_SYNC) == -1) {
+        inplace_error("could not write file");
+    }
+    munmap(base, st.st_size);
+}
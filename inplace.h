@@ -0,0 +1,17 @@
+/**
+ * @file inplace.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief In-place sorting of fixed-size binary records in a memory-mapped file.
+ **/
+
+#ifndef INPLACE_H
+#define INPLACE_H
+
+#include <stddef.h>
+
+void inplace_sort_records(char *base, size_t n, size_t record_size, int jobs);
+void inplace_sort(const char *path, size_t record_size, int jobs);
+
+#endif
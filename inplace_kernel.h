@@ -0,0 +1,203 @@
+/**
+ * @file inplace_kernel.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Template of the sort and partition kernels of the in-place engine, included once per record layout.
+ *
+ * Before every inclusion inplace.c defines
+ *   KERNEL(name)       the name of a function of this instance, e.g. name##_u64,
+ *   KERNEL_SIZE(ctx)   the record size, a constant for the fixed layouts,
+ *   KERNEL_CMP(ctx, a, b) the bytewise order of two records, inlined into every loop.
+ * All three are undefined at the end, so the next instance can define them again.
+ **/
+
+static inline char *KERNEL(rec)(const struct ctx *ctx, char *base, size_t i) {
+    (void) ctx;
+    return base + i * KERNEL_SIZE(ctx);
+}
+
+static inline void KERNEL(swap)(const struct ctx *ctx, char *a, char *b) {
+    char tmp[64];
+    for (size_t off = 0; off < KERNEL_SIZE(ctx); off += sizeof(tmp)) {
+        size_t len = KERNEL_SIZE(ctx) - off < sizeof(tmp) ? KERNEL_SIZE(ctx) - off : sizeof(tmp);
+        memcpy(tmp, a + off, len);
+        memcpy(a + off, b + off, len);
+        memcpy(b + off, tmp, len);
+    }
+}
+
+static void KERNEL(insertion_sort)(const struct ctx *ctx, char *base, size_t n) {
+    for (size_t i = 1; i < n; i++) {
+        for (size_t j = i; j > 0 && KERNEL_CMP(ctx, KERNEL(rec)(ctx, base, j - 1), KERNEL(rec)(ctx, base, j)) > 0; j--) {
+            KERNEL(swap)(ctx, KERNEL(rec)(ctx, base, j - 1), KERNEL(rec)(ctx, base, j));
+        }
+    }
+}
+
+static void KERNEL(sift_down)(const struct ctx *ctx, char *base, size_t i, size_t n) {
+    for (;;) {
+        size_t max = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && KERNEL_CMP(ctx, KERNEL(rec)(ctx, base, l), KERNEL(rec)(ctx, base, max)) > 0) {
+            max = l;
+        }
+        if (r < n && KERNEL_CMP(ctx, KERNEL(rec)(ctx, base, r), KERNEL(rec)(ctx, base, max)) > 0) {
+            max = r;
+        }
+        if (max == i) {
+            return;
+        }
+        KERNEL(swap)(ctx, KERNEL(rec)(ctx, base, i), KERNEL(rec)(ctx, base, max));
+        i = max;
+    }
+}
+
+static void KERNEL(heap_sort)(const struct ctx *ctx, char *base, size_t n) {
+    for (size_t i = n / 2; i-- > 0;) {
+        KERNEL(sift_down)(ctx, base, i, n);
+    }
+    for (size_t i = n; i-- > 1;) {
+        KERNEL(swap)(ctx, KERNEL(rec)(ctx, base, 0), KERNEL(rec)(ctx, base, i));
+        KERNEL(sift_down)(ctx, base, 0, i);
+    }
+}
+
+/**
+ * Sort records function
+ * @brief This function sorts records in place (introsort: quicksort, heapsort beyond the depth limit, insertion sort for small ranges).
+ * @param ctx The context (record size)
+ * @param base The first record
+ * @param n The number of records
+ * @param pivot A buffer of one record for the pivot
+ * @param depth The remaining recursion depth
+ */
+static void KERNEL(sort_records)(const struct ctx *ctx, char *base, size_t n, char *pivot, int depth) {
+    while (n > INSERTION_MAX) {
+        if (depth-- == 0) {
+            KERNEL(heap_sort)(ctx, base, n);
+            return;
+        }
+
+        // median of three, afterwards rec(0) <= rec(mid) <= rec(n - 1)
+        char *first = KERNEL(rec)(ctx, base, 0), *mid = KERNEL(rec)(ctx, base, n / 2), *last = KERNEL(rec)(ctx, base, n - 1);
+        if (KERNEL_CMP(ctx, mid, first) < 0) {
+            KERNEL(swap)(ctx, mid, first);
+        }
+        if (KERNEL_CMP(ctx, last, mid) < 0) {
+            KERNEL(swap)(ctx, last, mid);
+            if (KERNEL_CMP(ctx, mid, first) < 0) {
+                KERNEL(swap)(ctx, mid, first);
+            }
+        }
+        memcpy(pivot, mid, KERNEL_SIZE(ctx));
+
+        // Hoare partition, both parts are non-empty
+        size_t i = 0, j = n - 1;
+        for (;;) {
+            while (KERNEL_CMP(ctx, KERNEL(rec)(ctx, base, i), pivot) < 0) {
+                i++;
+            }
+            while (KERNEL_CMP(ctx, pivot, KERNEL(rec)(ctx, base, j)) < 0) {
+                j--;
+            }
+            if (i >= j) {
+                break;
+            }
+            KERNEL(swap)(ctx, KERNEL(rec)(ctx, base, i), KERNEL(rec)(ctx, base, j));
+            i++;
+            j--;
+        }
+
+        size_t left = j + 1;
+        if (left < n - left) {
+            KERNEL(sort_records)(ctx, base, left, pivot, depth);
+            base = KERNEL(rec)(ctx, base, left);
+            n -= left;
+        } else {
+            KERNEL(sort_records)(ctx, KERNEL(rec)(ctx, base, left), n - left, pivot, depth);
+            n = left;
+        }
+    }
+    KERNEL(insertion_sort)(ctx, base, n);
+}
+
+static void KERNEL(sort_all)(const struct ctx *ctx, char *base, size_t n) {
+    char *pivot = malloc(KERNEL_SIZE(ctx));
+    if (pivot == NULL) {
+        inplace_error("could not allocate pivot");
+    }
+    int depth = 0;
+    for (size_t m = n; m > 0; m >>= 1) {
+        depth += 2;
+    }
+    KERNEL(sort_records)(ctx, base, n, pivot, depth);
+    free(pivot);
+}
+
+/**
+ * Classify function
+ * @brief This function returns the bucket of a record, the number of splitters that are not greater than the record.
+ */
+static size_t KERNEL(classify)(const struct ctx *ctx, const char *r) {
+    size_t lo = 0, hi = ctx->buckets - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (KERNEL_CMP(ctx, KERNEL(rec)(ctx, ctx->splitters, mid), r) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void KERNEL(count_stripe)(struct ctx *ctx, int worker) {
+    size_t from = ctx->n * worker / ctx->jobs, to = ctx->n * (worker + 1) / ctx->jobs;
+    size_t *counts = ctx->counts + worker * ctx->buckets;
+    for (size_t i = from; i < to; i++) {
+        counts[KERNEL(classify)(ctx, KERNEL(rec)(ctx, ctx->base, i))] += 1;
+    }
+}
+
+static void KERNEL(sort_bucket)(struct ctx *ctx, int worker) {
+    size_t from = ctx->starts[worker], to = ctx->starts[worker + 1];
+    KERNEL(sort_all)(ctx, KERNEL(rec)(ctx, ctx->base, from), to - from);
+}
+
+/**
+ * Permute function
+ * @brief This function moves every record into its bucket by swapping it to the next free slot of the bucket (American flag sort).
+ */
+static void KERNEL(permute)(struct ctx *ctx) {
+    size_t *next = malloc(ctx->buckets * sizeof(*next));
+    if (next == NULL) {
+        inplace_error("could not allocate buckets");
+    }
+    memcpy(next, ctx->starts, ctx->buckets * sizeof(*next));
+
+    for (size_t b = 0; b < ctx->buckets; b++) {
+        while (next[b] < ctx->starts[b + 1]) {
+            char *r = KERNEL(rec)(ctx, ctx->base, next[b]);
+            size_t t = KERNEL(classify)(ctx, r);
+            if (t == b) {
+                next[b] += 1;
+            } else {
+                KERNEL(swap)(ctx, r, KERNEL(rec)(ctx, ctx->base, next[t]));
+                next[t] += 1;
+            }
+        }
+    }
+    free(next);
+}
+
+/** The kernels of this instance. */
+static const struct kernel KERNEL(kernel) = {
+    .sort_all = KERNEL(sort_all),
+    .count_stripe = KERNEL(count_stripe),
+    .sort_bucket = KERNEL(sort_bucket),
+    .permute = KERNEL(permute),
+};
+
+#undef KERNEL
+#undef KERNEL_SIZE
+#undef KERNEL_CMP
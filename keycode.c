@@ -0,0 +1,226 @@
+/**
+ * @file keycode.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Order-preserving compression of the input lines.
+ *
+ * The code is a weight-balanced alphabetic prefix code over all 256 byte values: the byte range is split recursively
+ * where the sampled frequencies of both halves are closest, the lower half gets a 0 bit and the upper half a 1 bit.
+ * Codes of smaller bytes are therefore smaller bit strings and no code is a prefix of another, so the encodings of two
+ * lines (newline included) first differ inside the codes of their first differing bytes and compare like the lines.
+ *
+ * The bits are packed 7 per byte into bytes 0x80 to 0xff, so an encoded line never contains a newline, a NUL or
+ * the mark of a long record and still ends with a newline.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "keycode.h"
+
+#define SYMBOLS 256
+
+/** Defines the maximum number of sampled lines and bytes. */
+#define SAMPLE_LINES 4096
+#define SAMPLE_BYTES (1 << 20)
+
+/** Defines the maximum code length, the weights of the sample keep the codes well below it. */
+#define MAX_CODE_BITS 56
+
+static bool active = false;
+static uint64_t codes[SYMBOLS];
+static unsigned char lengths[SYMBOLS];
+
+/** The decoding tree, a negative child -(s + 1) is the leaf of byte s. */
+static int tree[SYMBOLS][2];
+static int nodes = 0;
+
+static char *decoded = NULL;
+static size_t decoded_cap = 0;
+
+static void keycode_error(const char *msg) {
+    fprintf(stderr, "key compression: %s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Build code function
+ * @brief This function assigns the codes of the bytes [lo, hi) below a prefix and returns the node of the range.
+ * @param prefix The prefix sums of the weights
+ * @param lo The first byte of the range
+ * @param hi The end of the range
+ * @param code The code prefix of the range
+ * @param depth The length of the code prefix
+ * @return The node, or the leaf if the range holds one byte
+ */
+static int build(const uint64_t *prefix, int lo, int hi, uint64_t code, int depth) {
+    if (hi - lo == 1) {
+        if (depth > MAX_CODE_BITS) {
+            keycode_error("code too long");
+        }
+        codes[lo] = code;
+        lengths[lo] = depth;
+        return -(lo + 1);
+    }
+
+    int split = lo + 1;
+    uint64_t best = UINT64_MAX;
+    for (int k = lo + 1; k < hi; k++) {
+        uint64_t left = prefix[k] - prefix[lo], right = prefix[hi] - prefix[k];
+        uint64_t diff = left > right ? left - right : right - left;
+        if (diff < best) {
+            best = diff;
+            split = k;
+        }
+    }
+
+    int node = nodes++;
+    tree[node][0] = build(prefix, lo, split, code << 1, depth + 1);
+    tree[node][1] = build(prefix, split, hi, (code << 1) | 1, depth + 1);
+    return node;
+}
+
+/**
+ * Build function
+ * @brief This function builds the code from the byte frequencies of evenly spaced sample lines and activates it.
+ * @param lines The lines, each ending with a newline
+ * @param numlines The number of lines
+ */
+void keycode_build(char **lines, int numlines) {
+    uint64_t weight[SYMBOLS];
+    for (int s = 0; s < SYMBOLS; s++) {
+        // every byte needs a code, even if the sample misses it
+        weight[s] = 1;
+    }
+
+    int step = numlines > SAMPLE_LINES ? numlines / SAMPLE_LINES : 1;
+    size_t sampled = 0;
+    for (int i = 0; i < numlines && sampled < SAMPLE_BYTES; i += step) {
+        for (const unsigned char *p = (const unsigned char *) lines[i]; *p != '\0' && sampled < SAMPLE_BYTES; p++) {
+            weight[*p] += 1;
+            sampled += 1;
+        }
+    }
+
+    uint64_t prefix[SYMBOLS + 1];
+    prefix[0] = 0;
+    for (int s = 0; s < SYMBOLS; s++) {
+        prefix[s + 1] = prefix[s] + weight[s];
+    }
+    nodes = 0;
+    build(prefix, 0, SYMBOLS, 0, 0);
+    active = true;
+}
+
+bool keycode_active(void) {
+    return active;
+}
+
+/**
+ * Encode function
+ * @brief This function replaces a line by its encoding.
+ * @param line The line, ending with a newline, it is freed
+ * @param len The length of the line, replaced by the length of the encoding
+ * @return The encoding (allocated, ending with a newline)
+ */
+char *keycode_encode(char *line, size_t *len) {
+    const unsigned char *p = (const unsigned char *) line;
+    size_t bits = 0;
+    for (size_t i = 0; i < *len; i++) {
+        bits += lengths[p[i]];
+    }
+
+    size_t n = (bits + 6) / 7;
+    char *enc = malloc(n + 2);
+    if (enc == NULL) {
+        keycode_error("out of memory");
+    }
+    uint64_t acc = 0;
+    int have = 0;
+    size_t o = 0;
+    for (size_t i = 0; i < *len; i++) {
+        acc = (acc << lengths[p[i]]) | codes[p[i]];
+        have += lengths[p[i]];
+        while (have >= 7) {
+            have -= 7;
+            enc[o++] = (char) (0x80 | ((acc >> have) & 0x7f));
+        }
+    }
+    if (have > 0) {
+        enc[o++] = (char) (0x80 | ((acc << (7 - have)) & 0x7f));
+    }
+    enc[o] = '\n';
+    enc[o + 1] = '\0';
+
+    free(line);
+    *len = o + 1;
+    return enc;
+}
+
+/**
+ * Decode function
+ * @brief This function decodes an encoded line into a buffer that is reused by the next call.
+ * @param enc The encoded line without its newline
+ * @param len The length of the encoded line
+ * @param out_len The length of the decoded line without its newline
+ * @return The decoded line (not terminated)
+ */
+const char *keycode_decode(const char *enc, size_t len, size_t *out_len) {
+    size_t o = 0;
+    int node = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char) enc[i];
+        for (int b = 6; b >= 0; b--) {
+            node = tree[node][(c >> b) & 1];
+            if (node >= 0) {
+                continue;
+            }
+            int s = -node - 1;
+            if (s == '\n') {
+                *out_len = o;
+                return o > 0 ? decoded : "";
+            }
+            if (o == decoded_cap) {
+                decoded_cap = decoded_cap ? decoded_cap * 2 : 4096;
+                if ((decoded = realloc(decoded, decoded_cap)) == NULL) {
+                    keycode_error("out of memory");
+                }
+            }
+            decoded[o++] = (char) s;
+            node = 0;
+        }
+    }
+    keycode_error("truncated encoding");
+    return NULL;
+}
+
+/**
+ * Decoded size function
+ * @brief This function returns the length of the decoded line without its newline.
+ * @param enc The encoded line without its newline
+ * @param len The length of the encoded line
+ * @return The decoded length
+ */
+size_t keycode_decoded_size(const char *enc, size_t len) {
+    size_t o = 0;
+    int node = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char) enc[i];
+        for (int b = 6; b >= 0; b--) {
+            node = tree[node][(c >> b) & 1];
+            if (node >= 0) {
+                continue;
+            }
+            if (-node - 1 == '\n') {
+                return o;
+            }
+            o += 1;
+            node = 0;
+        }
+    }
+    keycode_error("truncated encoding");
+    return 0;
+}
@@ -0,0 +1,25 @@
+/**
+ * @file keycode.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Order-preserving compression of the input lines.
+ *
+ * The root builds an alphabetic prefix code for the bytes from a sample of the input and replaces every line by its
+ * encoding before the tree is forked. Encoded lines compare like the lines they stand for, so the tree sorts them
+ * unchanged and only the root decodes them again when it prints them.
+ **/
+
+#ifndef KEYCODE_H
+#define KEYCODE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+void keycode_build(char **lines, int numlines);
+bool keycode_active(void);
+char *keycode_encode(char *line, size_t *len);
+const char *keycode_decode(const char *enc, size_t len, size_t *out_len);
+size_t keycode_decoded_size(const char *enc, size_t len);
+
+#endif
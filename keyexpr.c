@@ -0,0 +1,428 @@
+/**
+ * @file keyexpr.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Key expressions compiled to bytecode (--key-expr=EXPR).
+ *
+ * A recursive descent parser emits the bytecode, an array of 32 bit words: an opcode followed by its immediates.
+ * The interpreter keeps a stack of values, each a slice of the record, of the literal pool or of a scratch buffer, so
+ * fields and substrings are never copied; only lower(), upper(), num() and concatenation write to the scratch buffer.
+ * The record is split into fields once, up to the highest field the expression uses.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+#include "keyexpr.h"
+#include "field.h"
+#include "compkey.h"
+#include "record.h"
+
+/** The opcodes and their immediates. */
+enum opcode {
+    OP_FIELD,   /* n: push field n */
+    OP_CONST,   /* offset, length: push a literal of the pool */
+    OP_LOWER,
+    OP_UPPER,
+    OP_SUBSTR,  /* start, length (-1 to the end): narrow the top value */
+    OP_NUM,
+    OP_CONCAT,  /* pop b, replace a by a . b */
+    OP_END
+};
+
+/** Where a value lies. */
+enum source {
+    SRC_RECORD,
+    SRC_POOL,
+    SRC_SCRATCH
+};
+
+/** A value of the stack, a slice of its source. */
+struct value {
+    enum source src;
+    size_t off, len;
+};
+
+struct keyexpr {
+    int32_t *code;
+    size_t code_len, code_cap;
+    char *pool;
+    size_t pool_len, pool_cap;
+    size_t depth, max_depth;
+    size_t max_field;
+    struct value *stack;
+    struct field *fields;
+    unsigned char *scratch;
+    size_t scratch_len, scratch_cap;
+};
+
+/** The state of the parser. */
+struct parser {
+    struct keyexpr *kx;
+    const char *source, *p;
+    const char *error;
+};
+
+static void *keyexpr_alloc(void *p, size_t size) {
+    p = realloc(p, size > 0 ? size : 1);
+    if (p == NULL) {
+        fprintf(stderr, "key-expr: Unable to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+/**
+ * Emit function
+ * @brief This function appends an opcode and its immediates to the bytecode and tracks the depth of the stack.
+ */
+static void emit(struct keyexpr *kx, enum opcode op, int32_t a, int32_t b) {
+    if (kx->code_len + 3 > kx->code_cap) {
+        kx->code_cap = 2 * kx->code_cap + 16;
+        kx->code = keyexpr_alloc(kx->code, kx->code_cap * sizeof(*kx->code));
+    }
+    kx->code[kx->code_len++] = op;
+    if (op == OP_FIELD) {
+        kx->code[kx->code_len++] = a;
+    } else if (op == OP_CONST || op == OP_SUBSTR) {
+        kx->code[kx->code_len++] = a;
+        kx->code[kx->code_len++] = b;
+    }
+    if (op == OP_FIELD || op == OP_CONST) {
+        kx->depth += 1;
+        kx->max_depth = kx->depth > kx->max_depth ? kx->depth : kx->max_depth;
+    } else if (op == OP_CONCAT) {
+        kx->depth -= 1;
+    }
+}
+
+static bool fail(struct parser *ps, const char *error) {
+    if (ps->error == NULL) {
+        ps->error = error;
+    }
+    return false;
+}
+
+static void skip_blanks(struct parser *ps) {
+    while (*ps->p == ' ' || *ps->p == '\t') {
+        ps->p++;
+    }
+}
+
+static bool expect(struct parser *ps, char c, const char *error) {
+    skip_blanks(ps);
+    if (*ps->p != c) {
+        return fail(ps, error);
+    }
+    ps->p++;
+    return true;
+}
+
+static bool parse_int(struct parser *ps, int32_t *v) {
+    skip_blanks(ps);
+    if (!isdigit((unsigned char) *ps->p)) {
+        return fail(ps, "expected a number");
+    }
+    int64_t n = 0;
+    while (isdigit((unsigned char) *ps->p)) {
+        n = n * 10 + (*ps->p++ - '0');
+        if (n > INT32_MAX) {
+            return fail(ps, "number too large");
+        }
+    }
+    *v = (int32_t) n;
+    return true;
+}
+
+static bool parse_string(struct parser *ps) {
+    struct keyexpr *kx = ps->kx;
+    char quote = *ps->p++;
+    size_t start = kx->pool_len;
+    while (*ps->p != quote) {
+        char c = *ps->p++;
+        if (c == '\0') {
+            return fail(ps, "unterminated string");
+        }
+        if (c == '\\') {
+            switch (*ps->p++) {
+                case '\\': c = '\\'; break;
+                case '"': c = '"'; break;
+                case '\'': c = '\''; break;
+                case 't': c = '\t'; break;
+                case 'n': c = '\n'; break;
+                default:
+                    ps->p--;
+                    return fail(ps, "unknown escape");
+            }
+        }
+        if (kx->pool_len == kx->pool_cap) {
+            kx->pool_cap = 2 * kx->pool_cap + 16;
+            kx->pool = keyexpr_alloc(kx->pool, kx->pool_cap);
+        }
+        kx->pool[kx->pool_len++] = c;
+    }
+    ps->p++;
+    if (kx->pool_len - start > INT32_MAX) {
+        return fail(ps, "string too long");
+    }
+    emit(kx, OP_CONST, (int32_t) start, (int32_t) (kx->pool_len - start));
+    return true;
+}
+
+static bool parse_expr(struct parser *ps);
+
+/**
+ * Parse call function
+ * @brief This function parses the arguments of a function after its name.
+ */
+static bool parse_call(struct parser *ps, const char *name, size_t len) {
+    if (!expect(ps, '(', "expected '('")) {
+        return false;
+    }
+    if (!parse_expr(ps)) {
+        return false;
+    }
+    if (len == 5 && strncmp(name, "lower", len) == 0) {
+        emit(ps->kx, OP_LOWER, 0, 0);
+    } else if (len == 5 && strncmp(name, "upper", len) == 0) {
+        emit(ps->kx, OP_UPPER, 0, 0);
+    } else if (len == 3 && strncmp(name, "num", len) == 0) {
+        emit(ps->kx, OP_NUM, 0, 0);
+    } else if (len == 6 && strncmp(name, "substr", len) == 0) {
+        int32_t start, length = -1;
+        if (!expect(ps, ',', "expected ','") || !parse_int(ps, &start)) {
+            return false;
+        }
+        skip_blanks(ps);
+        if (*ps->p == ',' && (ps->p++, !parse_int(ps, &length))) {
+            return false;
+        }
+        emit(ps->kx, OP_SUBSTR, start, length);
+    } else {
+        ps->p = name;
+        return fail(ps, "unknown function");
+    }
+    return expect(ps, ')', "expected ')'");
+}
+
+static bool parse_term(struct parser *ps) {
+    skip_blanks(ps);
+    if (*ps->p == '$') {
+        ps->p++;
+        int32_t n;
+        if (!parse_int(ps, &n)) {
+            return false;
+        }
+        ps->kx->max_field = (size_t) n > ps->kx->max_field ? (size_t) n : ps->kx->max_field;
+        emit(ps->kx, OP_FIELD, n, 0);
+        return true;
+    }
+    if (*ps->p == '"' || *ps->p == '\'') {
+        return parse_string(ps);
+    }
+    if (*ps->p == '(') {
+        ps->p++;
+        return parse_expr(ps) && expect(ps, ')', "expected ')'");
+    }
+    if (isalpha((unsigned char) *ps->p)) {
+        const char *name = ps->p;
+        while (isalpha((unsigned char) *ps->p)) {
+            ps->p++;
+        }
+        return parse_call(ps, name, ps->p - name);
+    }
+    return fail(ps, "expected a field, a string or a function");
+}
+
+static bool parse_expr(struct parser *ps) {
+    if (!parse_term(ps)) {
+        return false;
+    }
+    skip_blanks(ps);
+    while (*ps->p == '.') {
+        ps->p++;
+        if (!parse_term(ps)) {
+            return false;
+        }
+        emit(ps->kx, OP_CONCAT, 0, 0);
+        skip_blanks(ps);
+    }
+    return true;
+}
+
+/**
+ * Key expression compile function
+ * @brief This function compiles an expression to bytecode.
+ * @param source The expression
+ * @param error Set to a message if the expression is invalid
+ * @param error_pos Set to the offset of the error in the expression
+ * @return The compiled expression, NULL if it is invalid
+ */
+struct keyexpr *keyexpr_compile(const char *source, const char **error, size_t *error_pos) {
+    struct keyexpr *kx = keyexpr_alloc(NULL, sizeof(*kx));
+    memset(kx, 0, sizeof(*kx));
+    struct parser ps = { .kx = kx, .source = source, .p = source, .error = NULL };
+    if (parse_expr(&ps)) {
+        skip_blanks(&ps);
+        if (*ps.p != '\0') {
+            fail(&ps, "unexpected character");
+        }
+    }
+    if (ps.error != NULL) {
+        *error = ps.error;
+        *error_pos = ps.p - source;
+        free(kx->code);
+        free(kx->pool);
+        free(kx);
+        return NULL;
+    }
+    emit(kx, OP_END, 0, 0);
+    kx->stack = keyexpr_alloc(NULL, kx->max_depth * sizeof(*kx->stack));
+    kx->fields = keyexpr_alloc(NULL, kx->max_field * sizeof(*kx->fields));
+    compkey_enable();
+    return kx;
+}
+
+static void reserve(struct keyexpr *kx, size_t n) {
+    if (kx->scratch_len + n > kx->scratch_cap) {
+        kx->scratch_cap = 2 * (kx->scratch_len + n);
+        kx->scratch = keyexpr_alloc(kx->scratch, kx->scratch_cap);
+    }
+}
+
+static const unsigned char *base(const struct keyexpr *kx, const char *rec, enum source src) {
+    return src == SRC_RECORD ? (const unsigned char *) rec : src == SRC_POOL ? (const unsigned char *) kx->pool : kx->scratch;
+}
+
+/**
+ * Number function
+ * @brief This function converts the leading decimal number of a value to 8 bytes that compare like the numbers.
+ */
+static void number(const unsigned char *s, size_t len, unsigned char *dst) {
+    char buf[64];
+    len = len < sizeof(buf) - 1 ? len : sizeof(buf) - 1;
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    double d = strtod(buf, NULL);
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    bits = bits >> 63 ? ~bits : bits ^ UINT64_C(1) << 63;
+    for (int i = 7; i >= 0; i--) {
+        dst[i] = (unsigned char) bits;
+        bits >>= 8;
+    }
+}
+
+/**
+ * Key expression eval function
+ * @brief This function runs the bytecode on a record.
+ * @param kx The expression
+ * @param rec The record without its newline
+ * @param len The length of the record
+ * @param keylen Set to the length of the key
+ * @return The key, valid until the next call or until the record changes
+ */
+const unsigned char *keyexpr_eval(struct keyexpr *kx, const char *rec, size_t len, size_t *keylen) {
+    size_t numfields = field_split(rec, len, kx->fields, kx->max_field);
+    struct value *top = kx->stack - 1;
+    kx->scratch_len = 0;
+
+    for (const int32_t *pc = kx->code;;) {
+        switch ((enum opcode) *pc++) {
+            case OP_FIELD: {
+                size_t n = pc[0];
+                pc += 1;
+                *++top = n == 0 ? (struct value) { SRC_RECORD, 0, len }
+                       : n <= numfields ? (struct value) { SRC_RECORD, kx->fields[n - 1].start, kx->fields[n - 1].len }
+                       : (struct value) { SRC_RECORD, 0, 0 };
+                break;
+            }
+            case OP_CONST:
+                *++top = (struct value) { SRC_POOL, pc[0], pc[1] };
+                pc += 2;
+                break;
+            case OP_LOWER:
+            case OP_UPPER: {
+                // a scratch value belongs to this stack slot alone, so it is mapped in place
+                if (top->src != SRC_SCRATCH) {
+                    reserve(kx, top->len);
+                    memcpy(kx->scratch + kx->scratch_len, base(kx, rec, top->src) + top->off, top->len);
+                    *top = (struct value) { SRC_SCRATCH, kx->scratch_len, top->len };
+                    kx->scratch_len += top->len;
+                }
+                unsigned char *s = kx->scratch + top->off;
+                for (size_t i = 0; i < top->len; i++) {
+                    s[i] = (unsigned char) (pc[-1] == OP_LOWER ? tolower(s[i]) : toupper(s[i]));
+                }
+                break;
+            }
+            case OP_SUBSTR: {
+                size_t skip = (size_t) pc[0] < top->len ? (size_t) pc[0] : top->len;
+                top->off += skip;
+                top->len -= skip;
+                if (pc[1] >= 0 && (size_t) pc[1] < top->len) {
+                    top->len = pc[1];
+                }
+                pc += 2;
+                break;
+            }
+            case OP_NUM:
+                reserve(kx, 8);
+                number(base(kx, rec, top->src) + top->off, top->len, kx->scratch + kx->scratch_len);
+                *top = (struct value) { SRC_SCRATCH, kx->scratch_len, 8 };
+                kx->scratch_len += 8;
+                break;
+            case OP_CONCAT: {
+                struct value b = *top--;
+                if (top->src != SRC_SCRATCH || top->off + top->len != kx->scratch_len) {
+                    reserve(kx, top->len);
+                    memcpy(kx->scratch + kx->scratch_len, base(kx, rec, top->src) + top->off, top->len);
+                    *top = (struct value) { SRC_SCRATCH, kx->scratch_len, top->len };
+                    kx->scratch_len += top->len;
+                }
+                // b lies before the end of the scratch buffer, so the copy does not overlap
+                reserve(kx, b.len);
+                memcpy(kx->scratch + kx->scratch_len, base(kx, rec, b.src) + b.off, b.len);
+                kx->scratch_len += b.len;
+                top->len += b.len;
+                break;
+            }
+            case OP_END:
+                *keylen = top->len;
+                return base(kx, rec, top->src) + top->off;
+        }
+    }
+}
+
+/**
+ * Key expression line function
+ * @brief This function replaces a line by the composite line of its key and record.
+ * @details The key is derived from the whole record, the record is projected afterwards if fields are projected.
+ * @param kx The expression
+ * @param line The line, ending with a newline, it is freed
+ * @param len The length of the line, set to the length of the composite line
+ * @return The composite line
+ */
+char *keyexpr_line(struct keyexpr *kx, char *line, size_t *len) {
+    const char *text = line;
+    size_t textlen = *len - 1;
+    if (record_active()) {
+        text = record_text(line, textlen, &textlen);
+    }
+    size_t keylen;
+    const unsigned char *key = keyexpr_eval(kx, text, textlen, &keylen);
+    const char *body = line;
+    size_t bodylen = *len - 1;
+    if (field_projecting()) {
+        body = field_project(line, bodylen, &bodylen);
+    }
+    char *composite = compkey_line(key, keylen, body, bodylen);
+    free(line);
+    *len = strlen(composite);
+    return composite;
+}
@@ -0,0 +1,34 @@
+/**
+ * @file keyexpr.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Key expressions compiled to bytecode (--key-expr=EXPR).
+ *
+ * An expression derives the sort key of a record from its fields:
+ *
+ *     expr := term { '.' term }                 concatenation
+ *     term := '$' N                             field N (see field.h), $0 is the whole record
+ *           | "text" | 'text'                   a literal, with the escapes \\ \" \' \t \n
+ *           | lower(expr) | upper(expr)         ASCII case mapping
+ *           | substr(expr, START [, LENGTH])    LENGTH bytes from byte START (from 0), to the end without LENGTH
+ *           | num(expr)                         the leading decimal number (0 without one), as 8 bytes that order
+ *                                               like the numbers
+ *           | '(' expr ')'
+ *
+ * e.g. lower($3) . substr($1, 0, 8). The expression is compiled once to a stack bytecode that the root runs per
+ * record while it reads the input, and the record is sorted by the key (see compkey.h).
+ **/
+
+#ifndef KEYEXPR_H
+#define KEYEXPR_H
+
+#include <stddef.h>
+
+struct keyexpr;
+
+struct keyexpr *keyexpr_compile(const char *source, const char **error, size_t *error_pos);
+const unsigned char *keyexpr_eval(struct keyexpr *kx, const char *rec, size_t len, size_t *keylen);
+char *keyexpr_line(struct keyexpr *kx, char *line, size_t *len);
+
+#endif
@@ -0,0 +1,36 @@
+/**
+ * @file line.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Line comparison shared by the modules that read sorted outputs.
+ **/
+
+#ifndef LINE_H
+#define LINE_H
+
+#include <string.h>
+
+/**
+ * Compare line function
+ * @brief This function compares two lines (without their newlines) as if each was followed by its newline.
+ * @details This is the order strcmp() gives the newline terminated lines of the sort, so a line sorts
+ * after its extensions that continue with a byte below '\n'.
+ * @param a The first line
+ * @param alen The length of the first line
+ * @param b The second line
+ * @param blen The length of the second line
+ * @return A negative, zero or positive value like strcmp()
+ */
+static inline int cmp_line(const char *a, size_t alen, const char *b, size_t blen) {
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+    if (c != 0 || alen == blen) {
+        return c;
+    }
+    if (alen < blen) {
+        return '\n' < (unsigned char) b[alen] ? -1 : 1;
+    }
+    return (unsigned char) a[blen] < '\n' ? -1 : 1;
+}
+
+#endif
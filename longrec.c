@@ -0,0 +1,224 @@
+/**
+ * @file longrec.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Out-of-line storage of long lines.
+ *
+ * The root appends the bodies of long lines to an unlinked temporary file before the tree is forked, the children
+ * inherit its descriptor and map it read-only. A comparison touches a body only if the prefixes in the references
+ * do not decide it, and only the root copies a body again, when it prints the line.
+ *
+ * Lines order like strcmp() orders them including their newline, so "ab\tc" sorts before "ab", see cmp_line().
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "longrec.h"
+#include "line.h"
+#include "trace.h"
+
+/** The size of a reference without its prefix: the mark and two 16 digit hex numbers. */
+#define HEADER (1 + 2 * 16)
+
+static FILE *spill = NULL;
+static int spill_fd = -1;
+static off_t spilled = 0;
+static const char *map = NULL;
+
+/**
+ * Long record error function
+ * @brief This function writes an error of the spill file to stderr and exits with an EXIT_FAILURE status
+ * @param msg The message
+ */
+static void longrec_error(const char *msg) {
+    fprintf(stderr, "long records: %s: %s\n", msg, strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+static unsigned long long parse_hex(const char *p) {
+    unsigned long long v = 0;
+    for (int i = 0; i < 16; i++) {
+        v = (v << 4) | (unsigned) (p[i] <= '9' ? p[i] - '0' : p[i] - 'a' + 10);
+    }
+    return v;
+}
+
+/**
+ * Store function
+ * @brief This function appends the body of a line to the spill file and returns the reference that replaces the line.
+ * @param line The line, ending with a newline, it is freed
+ * @param len The length of the line
+ * @return The reference (allocated, ending with a newline)
+ */
+char *longrec_store(char *line, size_t len) {
+    size_t body = len - 1;
+    if (spill == NULL) {
+        if ((spill = tmpfile()) == NULL) {
+            longrec_error("could not create spill file");
+        }
+        spill_fd = fileno(spill);
+    }
+    if (fwrite(line, 1, body, spill) != body) {
+        longrec_error("could not write spill file");
+    }
+
+    size_t prefix = body < LONGREC_PREFIX ? body : LONGREC_PREFIX;
+    char *ref = malloc(HEADER + prefix + 2);
+    if (ref == NULL) {
+        longrec_error("could not allocate reference");
+    }
+    ref[0] = LONGREC_MARK;
+    snprintf(ref + 1, HEADER, "%016llx%016llx", (unsigned long long) spilled, (unsigned long long) body);
+    memcpy(ref + HEADER, line, prefix);
+    ref[HEADER + prefix] = '\n';
+    ref[HEADER + prefix + 1] = '\0';
+
+    // only the root stores long lines
+    TRACE3(spill, 0, spilled, body);
+    spilled += body;
+    free(line);
+    return ref;
+}
+
+/**
+ * Flush function
+ * @brief This function writes the buffered bodies to the spill file, it must be called before the tree is forked.
+ */
+void longrec_flush(void) {
+    if (spill != NULL && fflush(spill) == EOF) {
+        longrec_error("could not write spill file");
+    }
+}
+
+/**
+ * File descriptor function
+ * @return The file descriptor of the spill file, -1 if no line was stored out-of-line
+ */
+int longrec_fd(void) {
+    return spill_fd;
+}
+
+/**
+ * Attach function
+ * @brief This function makes the spill file of the root (inherited descriptor) known to a child.
+ * @param fd The inherited file descriptor
+ */
+void longrec_attach(int fd) {
+    spill_fd = fd;
+}
+
+/**
+ * Spilled function
+ * @return The number of body bytes stored out-of-line
+ */
+off_t longrec_spilled(void) {
+    return spilled;
+}
+
+/**
+ * Is reference function
+ * @return true if the line is a reference, lines are only replaced by references once a spill file exists
+ */
+bool longrec_is_ref(const char *line) {
+    return spill_fd != -1 && line[0] == LONGREC_MARK;
+}
+
+/**
+ * Printed size function
+ * @brief This function returns the number of bytes the root prints for a line, newline included.
+ * @param line The line or reference
+ * @return The printed size
+ */
+size_t longrec_size(const char *line) {
+    if (longrec_is_ref(line)) {
+        return (size_t) parse_hex(line + 17) + 1;
+    }
+    return strlen(line);
+}
+
+/**
+ * Body function
+ * @brief This function resolves a reference to its body in the mapped spill file.
+ * @param line The reference
+ * @param body The body (not terminated)
+ * @param len The length of the body
+ */
+void longrec_body(const char *line, const char **body, size_t *len) {
+    if (map == NULL) {
+        struct stat st;
+        if (spill_fd == -1 || fstat(spill_fd, &st) == -1) {
+            longrec_error("no spill file for a long record");
+        }
+        if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, spill_fd, 0)) == MAP_FAILED) {
+            longrec_error("could not map spill file");
+        }
+    }
+    *body = map + parse_hex(line + 1);
+    *len = parse_hex(line + 17);
+}
+
+/** The bytes of a line that are available without touching the spill file. */
+struct view {
+    const char *p;
+    size_t n;
+    bool complete;
+};
+
+static void make_view(const char *line, struct view *v) {
+    if (longrec_is_ref(line)) {
+        v->p = line + HEADER;
+        v->n = strlen(v->p) - 1;
+        v->complete = parse_hex(line + 17) == v->n;
+    } else {
+        v->p = line;
+        v->n = strlen(line) - 1;
+        v->complete = true;
+    }
+}
+
+/**
+ * Compare function
+ * @brief This function compares two lines that may be references, like strcmp() compares the lines they stand for.
+ * @details Plain lines are compared with strcmp(). Otherwise the prefixes are compared first and the bodies are
+ * only looked up if the prefixes are equal as far as the shorter incomplete one goes.
+ * @param a The first line
+ * @param b The second line
+ * @return A negative, zero or positive value like strcmp()
+ */
+int longrec_cmp(const char *a, const char *b) {
+    if (!longrec_is_ref(a) && !longrec_is_ref(b)) {
+        return strcmp(a, b);
+    }
+
+    struct view va, vb;
+    make_view(a, &va);
+    make_view(b, &vb);
+    size_t m = va.n < vb.n ? va.n : vb.n;
+    int c = memcmp(va.p, vb.p, m);
+    if (c != 0) {
+        return c;
+    }
+    // a complete view that ended first is decided by the next available byte of the other one
+    if ((va.n == m && va.complete) && (vb.n > m || vb.complete)) {
+        return cmp_line(va.p, va.n, vb.p, vb.n);
+    }
+    if ((vb.n == m && vb.complete) && va.n > m) {
+        return cmp_line(va.p, va.n, vb.p, vb.n);
+    }
+
+    const char *abody = va.p, *bbody = vb.p;
+    size_t alen = va.n, blen = vb.n;
+    if (longrec_is_ref(a)) {
+        longrec_body(a, &abody, &alen);
+    }
+    if (longrec_is_ref(b)) {
+        longrec_body(b, &bbody, &blen);
+    }
+    return cmp_line(abody, alen, bbody, blen);
+}
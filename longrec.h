@@ -0,0 +1,37 @@
+/**
+ * @file longrec.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Out-of-line storage of long lines.
+ *
+ * A line longer than the threshold is stored once in a spill file that every process of the tree maps.
+ * Only a reference travels through the tree: LONGREC_MARK, the offset and length of the body (16 hex digits each)
+ * and the first LONGREC_PREFIX bytes of the body.
+ **/
+
+#ifndef LONGREC_H
+#define LONGREC_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/** The first byte of a reference. Short lines starting with it are stored out-of-line as well. */
+#define LONGREC_MARK '\x1f'
+
+/** Defines the number of body bytes that are copied into a reference. */
+#define LONGREC_PREFIX 64
+
+char *longrec_store(char *line, size_t len);
+void longrec_flush(void);
+int longrec_fd(void);
+void longrec_attach(int fd);
+off_t longrec_spilled(void);
+
+bool longrec_is_ref(const char *line);
+size_t longrec_size(const char *line);
+void longrec_body(const char *line, const char **body, size_t *len);
+int longrec_cmp(const char *a, const char *b);
+
+#endif
@@ -16,6 +16,32 @@
 #include <sys/wait.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "index.h"
+#include "store.h"
+#include "inplace.h"
+#include "partition.h"
+#include "dio.h"
+#include "longrec.h"
+#include "keycode.h"
+#include "ring.h"
+#include "trace.h"
+#include "accounting.h"
+#include "watchdog.h"
+#include "metrics.h"
+#include "memsort.h"
+#include "funnel.h"
+#include "record.h"
+#include "compkey.h"
+#include "plugin.h"
+#include "columnar.h"
+#include "field.h"
+#include "keyexpr.h"
+#include "where.h"
 
 /** Defines the step size in which the lines array can grow if the max number of elements is reached. */
 #define STEPSIZE 10;
@@ -26,6 +52,76 @@ static char *pgm_name;
 /** Defines the max buffer size for the merge sort buffers. */
 static ssize_t max_buffer_size = 0;
 
+/** Defines the default length above which lines are stored out-of-line (64 KiB). */
+#define DEFAULT_LONG_THRESHOLD (64 * 1024)
+
+/** Defines the default number of lines up to which the root sorts without children (--small-threshold). */
+#define DEFAULT_SMALL_THRESHOLD 1024
+
+/** Defines the size of the output buffer of small sorts, which are printed with a single write (64 KiB). */
+#define SMALL_BUFFER_SIZE (64 * 1024)
+
+/** Defines the size of the blocks the pipes of the merge are read in (64 KiB), a block grows for longer lines. */
+#define MERGE_BLOCK_SIZE (64 * 1024)
+
+/** Defines the alignment of the merge blocks. */
+#define MERGE_BLOCK_ALIGN 4096
+
+/** Defines the default size bound of the result cache (1 GiB). */
+#define DEFAULT_CACHE_SIZE ((off_t) 1 << 30)
+
+/** The stream the sorted lines are printed to. */
+static FILE *out;
+
+/** true if this process was started by a parent of the tree (and prints to it), false for the root. */
+static bool child = false;
+
+/** true if the children forward the resource usage of their subtrees (--rusage). */
+static bool rusage = false;
+
+/** The node table of the watchdog, -1 without a watchdog. */
+static int watch_fd = -1;
+
+/** The key extraction module (--plugin), NULL without one. */
+static const char *plugin_path = NULL;
+
+/** The key expression (--key-expr), NULL without one. */
+static const char *key_source = NULL;
+
+/** The shared counters of --metrics-file, -1 without metrics. */
+static int metrics_fd = -1;
+
+/** The engines that sort the lines of a node: a process tree, or in memory by this process. */
+enum engine {
+    ENGINE_TREE,
+    ENGINE_MEM,
+    ENGINE_FUNNEL
+};
+
+/** The engine that sorts the lines (--engine). */
+static enum engine engine = ENGINE_TREE;
+
+/** The number of merges the memory engine interleaves (--interleave). */
+static unsigned lanes = MEMSORT_DEFAULT_LANES;
+
+/** The number of line comparisons of the merges of this process. */
+static uint64_t comparisons = 0;
+
+/** The depth of this process in the tree, 0 for the root. */
+static int depth = 0;
+
+/** The arguments a child process is started with. */
+static char *child_argv[16];
+
+/** true if parents and children are connected by shared memory rings, false for pipes. */
+static bool rings = true;
+
+/** The ring a child prints to, NULL if it prints to stdout. */
+static struct ring *out_ring = NULL;
+
+/** The sparse index of the printed lines, NULL if no index is written. */
+static struct sparse_index *out_index = NULL;
+
 /**
  * Error exit function.
  * @brief This function writes helpful error information about the program to stderr and exits with an EXIT_FAILURE status
@@ -37,17 +133,78 @@ static void error_exit(const char *msg) {
 }
 
 /**
- * Read Line function
- * @brief This function reads a line from a stream and exits if the line couldn't be read.
- * @param lineptr The pointer of a line (char*)
- * @param n The pointer of a size_t variable
- * @param stream The stream that is read from
+ * Alloc block function
+ * @brief This function allocates the page aligned block a pipe of the merge is read into.
+ * @param size The size of the block, one spare byte is added for the terminator of a line at its end
+ * @return The block
  */
-static void readline(char **lineptr, size_t *n, FILE *stream) {
-    if (getline(lineptr, n, stream) == -1) {
-        free(*lineptr);
-        error_exit("Could not read line");
+static char *alloc_block(size_t size) {
+    void *block;
+    if (posix_memalign(&block, MERGE_BLOCK_ALIGN, size + 1) != 0) {
+        error_exit("Unable to allocate merge block");
     }
+    return block;
+}
+
+/**
+ * Read input function
+ * @brief This function reads the next input line from stdin or, in a child connected by rings, from its input ring.
+ * @param in The input ring, NULL for stdin
+ * @param lineptr The pointer of a line (char*), allocated like getline() does
+ * @param n The pointer of the size of the line buffer
+ * @return The length of the line or -1 at the end of the input
+ */
+static ssize_t read_input(struct ring *in, char **lineptr, size_t *n) {
+    if (in == NULL) {
+        return getline(lineptr, n, stdin);
+    }
+    size_t len;
+    char *line = ring_get(in, &len);
+    if (line == NULL) {
+        return -1;
+    }
+    if (*lineptr == NULL || *n < len + 1) {
+        char *grown = realloc(*lineptr, len + 1);
+        if (grown == NULL) {
+            error_exit("Unable to reallocate memory for line");
+        }
+        *lineptr = grown;
+        *n = len + 1;
+    }
+    memcpy(*lineptr, line, len + 1);
+    return len;
+}
+
+/**
+ * Printed body function
+ * @brief This function returns the text a line is printed as, without its newline.
+ * @details A child prints the line as it is. The root prints the body a long line stands for, decoded, without its key
+ * and unescaped. The text may lie in a static buffer that is valid until the next call.
+ * @param line The line
+ * @param len Set to the length of the text
+ * @return The text
+ */
+static const char *printed_body(const char *line, size_t *len) {
+    const char *body = line;
+    *len = strlen(line);
+    if (!child && longrec_is_ref(line)) {
+        longrec_body(line, &body, len);
+    } else if (line[*len - 1] == '\n') {
+        *len -= 1;
+    }
+    if (child) {
+        return body;
+    }
+    if (keycode_active()) {
+        body = keycode_decode(body, *len, len);
+    }
+    if (compkey_active()) {
+        body = compkey_record(body, *len, len);
+    }
+    if (record_active()) {
+        body = record_unescape(body, *len, len);
+    }
+    return body;
 }
 
 /**
@@ -56,11 +213,47 @@ static void readline(char **lineptr, size_t *n, FILE *stream) {
  * @param line The line that is printed
  */
 static void print(char *line) {
-    size_t len = strlen(line);
-    if (line[len - 1] == '\n') {
-        line[len - 1] = '\0';
+    static unsigned long printed = 0;
+    if (++printed % TRACE_EVERY == 0) {
+        TRACE2(merge__progress, depth, printed);
+    }
+    watch_tick();
+
+    if (out_ring != NULL) {
+        ring_put(out_ring, line, strlen(line));
+        return;
+    }
+
+    size_t len;
+    const char *body = printed_body(line, &len);
+    if (out_index != NULL) {
+        index_add(out_index, body, len);
+    }
+    fwrite(body, 1, len, out);
+    putc('\n', out);
+}
+
+/**
+ * Printed size function
+ * @brief This function returns the number of bytes the root prints for a line, newline included.
+ * @param line The line
+ * @return The printed size
+ */
+static size_t printed_size(const char *line) {
+    if (!keycode_active() && !compkey_active() && !record_active()) {
+        return longrec_size(line);
     }
-    printf("%s\n", line);
+    size_t len;
+    if (keycode_active() && !compkey_active() && !record_active()) {
+        const char *body = line;
+        len = strlen(line) - 1;
+        if (longrec_is_ref(line)) {
+            longrec_body(line, &body, &len);
+        }
+        return keycode_decoded_size(body, len) + 1;
+    }
+    printed_body(line, &len);
+    return len + 1;
 }
 
 /**
@@ -69,10 +262,194 @@ static void print(char *line) {
  * @details global variables: pgm_name
  */
 static void usage(void) {
-	(void) fprintf(stderr, "USAGE: %s\n", pgm_name);
+	(void) fprintf(stderr, "USAGE: %s [--output=FILE] [--jobs=N] [--engine=tree|mem|funnel [--interleave=N]] [--paragraph | --record-start=REGEX] [--plugin=LIB.so | --key-expr=EXPR] [--output-fields=LIST] [--where=FILTER]... [--field-separator=CHAR] [--transport=ring|pipe] [--rusage] [--watchdog=SECS] [--metrics-file=FILE] [--small-threshold=LINES] [--direct-io] [--long-threshold=BYTES] [--compress-keys] [--cache=DIR [--cache-size=BYTES]] [--index=FILE [--index-block=BYTES]]\n"
+                          "       %s --in-place=FILE --record-size=BYTES [--jobs=N]\n"
+                          "       %s --columnar=KEYS [--jobs=N]\n"
+                          "       %s lookup OUTPUT INDEX FIRST [LAST]\n"
+                          "       %s store add [--policy=tiered|leveled] [--direct-io] DIR\n"
+                          "       %s store cat|compact DIR\n", pgm_name, pgm_name, pgm_name, pgm_name, pgm_name, pgm_name);
 	exit(EXIT_FAILURE);
 }
 
+/**
+ * Parse size function
+ * @brief This function parses a byte count with an optional K, M or G suffix and exits with the usage if it is malformed.
+ * @param arg The option argument
+ * @return The byte count
+ */
+static off_t parse_size(const char *arg) {
+    char *end;
+    errno = 0;
+    long long size = strtoll(arg, &end, 10);
+    if (errno != 0 || end == arg || size < 0) {
+        usage();
+    }
+    switch (*end) {
+        case 'G':
+            size <<= 10;
+            /* fall through */
+        case 'M':
+            size <<= 10;
+            /* fall through */
+        case 'K':
+            size <<= 10;
+            end++;
+            break;
+        default:
+            break;
+    }
+    if (*end != '\0') {
+        usage();
+    }
+    return (off_t) size;
+}
+
+/**
+ * Hash options function
+ * @brief This function adds every option that changes the sorted output to the cache digest.
+ * @param hash The digest of the input
+ */
+static void hash_options(struct cache_hash *hash) {
+    const char *version = "forksort-1";
+    cache_hash_update(hash, version, strlen(version));
+    // the record mode changes the output of the same input
+    const char *records = record_describe();
+    cache_hash_update(hash, records, strlen(records) + 1);
+    if (plugin_path != NULL) {
+        cache_hash_update(hash, plugin_path, strlen(plugin_path) + 1);
+    }
+    if (where_active()) {
+        const char *filters = where_describe();
+        cache_hash_update(hash, filters, strlen(filters) + 1);
+    }
+    if (key_source != NULL || field_projecting() || where_active()) {
+        int separator = field_separator();
+        const char *fields = field_describe_projection();
+        cache_hash_update(hash, key_source != NULL ? key_source : "", key_source != NULL ? strlen(key_source) + 1 : 1);
+        cache_hash_update(hash, fields, strlen(fields) + 1);
+        cache_hash_update(hash, (const char *) &separator, sizeof(separator));
+    }
+}
+
+/**
+ * An input of the merge, the sorted lines of a child read from a pipe (fd) or a ring.
+ * A pipe is read into a block, the unread bytes are block[start, end). The current line is terminated in the block
+ * by overwriting the byte after its newline, which is kept in saved until the next line is read.
+ */
+struct source {
+    int fd;
+    struct ring ring;
+    size_t len;
+    char *block;
+    size_t size, start, end;
+    char *saved_at;
+    char saved;
+};
+
+/**
+ * Source open function
+ * @brief This function sets up the merge input of a pipe.
+ * @param src The input
+ * @param fd The read end of the pipe
+ */
+static void source_open(struct source *src, int fd) {
+    src->fd = fd;
+    src->block = alloc_block(MERGE_BLOCK_SIZE);
+    src->size = MERGE_BLOCK_SIZE;
+    src->start = src->end = 0;
+    src->saved_at = NULL;
+}
+
+/**
+ * Source fill function
+ * @brief This function moves the unread bytes of a pipe input to the front of its block and reads more behind them.
+ * @details A block that holds only part of a single line is doubled.
+ * @param src The input
+ */
+static void source_fill(struct source *src) {
+    if (src->start > 0) {
+        memmove(src->block, src->block + src->start, src->end - src->start);
+        src->end -= src->start;
+        src->start = 0;
+    }
+    if (src->end == src->size) {
+        char *grown = alloc_block(2 * src->size);
+        memcpy(grown, src->block, src->end);
+        free(src->block);
+        src->block = grown;
+        src->size *= 2;
+    }
+    ssize_t n;
+    while ((n = read(src->fd, src->block + src->end, src->size - src->end)) == -1 && errno == EINTR) {
+    }
+    if (n <= 0) {
+        error_exit("Could not read line");
+    }
+    src->end += n;
+}
+
+/**
+ * Source next function
+ * @brief This function reads the next line of a merge input and exits if there is none.
+ * @details The line is used where it lies, in the ring or in the block of the pipe, and stays valid until the next call.
+ * @param src The input
+ * @return The line
+ */
+static char *source_next(struct source *src) {
+    if (src->fd == -1) {
+        char *line = ring_get(&src->ring, &src->len);
+        if (line == NULL) {
+            error_exit("Could not read line");
+        }
+        return line;
+    }
+    if (src->saved_at != NULL) {
+        *src->saved_at = src->saved;
+        src->saved_at = NULL;
+    }
+    char *newline;
+    while ((newline = memchr(src->block + src->start, '\n', src->end - src->start)) == NULL) {
+        source_fill(src);
+    }
+    char *line = src->block + src->start;
+    src->start = newline + 1 - src->block;
+    src->saved_at = newline + 1;
+    src->saved = *src->saved_at;
+    *src->saved_at = '\0';
+    return line;
+}
+
+/**
+ * Source close function
+ * @brief This function closes a merge input.
+ * @details With --rusage, the usage table the child forwarded after its lines is read first.
+ * @param src The input
+ */
+static void source_close(struct source *src) {
+    if (rusage) {
+        int count = atoi(source_next(src));
+        for (int i = 0; i < count; i++) {
+            acct_merge_line(source_next(src));
+        }
+    }
+    if (src->fd == -1) {
+        ring_unmap(&src->ring);
+        return;
+    }
+    free(src->block);
+    close(src->fd);
+}
+
+/**
+ * Compare function
+ * @brief This function compares two lines of the merge and counts the comparison.
+ * @return The result of longrec_cmp()
+ */
+static int compare(const char *left, const char *right) {
+    comparisons += 1;
+    return longrec_cmp(left, right);
+}
+
 /**
  * Compare and lock element function
  * @brief This function compares two strings and locks elements accordingly and increases the processed count
@@ -86,7 +463,7 @@ static void usage(void) {
 static void cmp_lock(char *left, char *right, int *lock, int *processed_c1, int *processed_c2) {
     switch (*lock) {
         case 0:
-            if (strcmp(left, right) < 0) {
+            if (compare(left, right) < 0) {
                 print(left);
                 *lock = 2;
                 *processed_c1 += 1;
@@ -97,7 +474,7 @@ static void cmp_lock(char *left, char *right, int *lock, int *processed_c1, int
             }
             break;
         case 1:
-            if (strcmp(left, right) < 0) {
+            if (compare(left, right) < 0) {
                 print(left);
                 *lock = 2;
                 *processed_c1 += 1;
@@ -107,7 +484,7 @@ static void cmp_lock(char *left, char *right, int *lock, int *processed_c1, int
             }
             break;
         case 2:
-            if (strcmp(left, right) < 0) {
+            if (compare(left, right) < 0) {
                 print(left);
                 *processed_c1 += 1;
             } else {
@@ -123,8 +500,8 @@ static void cmp_lock(char *left, char *right, int *lock, int *processed_c1, int
 
 /**
  * Mergesort function
- * @brief This function opens the two file descriptors as streams and sorts the input using mergesort without using char* arrays
- * @details This function reads each line (visually from left list and right list) and compares them via strcmp(). The smaller line is printed and the bigger line is
+ * @brief This function merges the two sorted inputs using mergesort without using char* arrays
+ * @details This function reads each line (visually from left list and right list) and compares them via longrec_cmp() (strcmp() unless a line is stored out-of-line). The smaller line is printed and the bigger line is
  * saved in a buffer and the bufferstate is set accordingly. The list of the smaller value is kept being read while the buffer element is locked until either
  * the processed count is the same count as the smaller list or the element of the smaller list is in some iteration bigger than the buffer.
  * At the end, the locked element is printed. Finally, the remaining words are printed of the list, where the processing count is smaller than list count
@@ -148,30 +525,23 @@ static void cmp_lock(char *left, char *right, int *lock, int *processed_c1, int
             >> AN, DO, HE, HU, TH
             
  *
- * @param fd1 File descriptor from rd pipe 1 read end
- * @param fd2 File descriptor from rd pipe 2 read end
+ * @param src1 The input of child 1 (rd pipe 1 or its ring)
+ * @param src2 The input of child 2 (rd pipe 2 or its ring)
  * @param wr_count1 Number of elements that were written into pipe 1
  * @param wr_count2 Number of elements that were written into pipe 2
  */
-static void mergesort(int fd1, int fd2, int wr_count1, int wr_count2) {
-    FILE *file1 = fdopen(fd1, "r");	
-    FILE *file2 = fdopen(fd2, "r");	
-    if (file1 == NULL || file2 == NULL) {
-        error_exit("File is null");
-    }
-
+static void mergesort(struct source *src1, struct source *src2, int wr_count1, int wr_count2) {
     char *left = NULL;
     char *right = NULL;
-    size_t len1 = 0;
-    size_t len2 = 0;
     int lock = 0;
     int processed_c1 = 0, processed_c2 = 0;
+    TRACE2(merge__start, depth, wr_count1 + wr_count2);
 
     // Trivial case: both lists only have one element
     if ((wr_count1 == 1 && wr_count2 == 1)) {
-        readline(&left, &len1, file1);
-        readline(&right, &len2, file2);
-        if (strcmp(left, right) < 0) {
+        left = source_next(src1);
+        right = source_next(src2);
+        if (compare(left, right) < 0) {
             print(left); 
             print(right);
         } else {
@@ -180,27 +550,26 @@ static void mergesort(int fd1, int fd2, int wr_count1, int wr_count2) {
         }
 
         // free resources
-        free(left);
-        free(right);
-        fclose(file1);
-        fclose(file2);
-        exit(EXIT_SUCCESS);
+        source_close(src1);
+        source_close(src2);
+        TRACE2(merge__end, depth, wr_count1 + wr_count2);
+        return;
     }
 
     while (processed_c1 != wr_count1 && processed_c2 != wr_count2) {
         switch(lock) {
             case 0:
                 // no list is locked, continue reading from both lists
-                readline(&left, &len1, file1);
-                readline(&right, &len2, file2);
+                left = source_next(src1);
+                right = source_next(src2);
                 break;
             case 1:
                 // left list is locked, continue reading from right list
-                readline(&right, &len2, file2);
+                right = source_next(src2);
                 break;
             case 2:
                 // right list is locked, continue reading from left list
-                readline(&left, &len1, file1);
+                left = source_next(src1);
                 break;
             default:
                 error_exit("lock cannot be > 2");
@@ -225,66 +594,182 @@ static void mergesort(int fd1, int fd2, int wr_count1, int wr_count2) {
     // Read and print the remaining elements
     if (processed_c1 != wr_count1) {
         for (int i = processed_c1; i < wr_count1; i++) {
-            readline(&left, &len1, file1);
+            left = source_next(src1);
             print(left);
         }
     } else if (processed_c2 != wr_count2) {
         for (int i = processed_c2; i < wr_count2; i++) {
-            readline(&right, &len2, file2);
+            right = source_next(src2);
             print(right);
         }
     }
 
     // free resources
-    free(left);
-    free(right);
-    fclose(file1);
-    fclose(file2);
+    source_close(src1);
+    source_close(src2);
+    TRACE2(merge__end, depth, wr_count1 + wr_count2);
 }
 
-int main(int argc, char *argv[]) {
-    pgm_name = argv[0];
-
-    if(argc != 1) {
-        usage();
+/**
+ * Exec child function
+ * @brief This function replaces a forked child by this program, started with the child arguments and its own ones.
+ * @param which The number of the child (0 or 1)
+ * @param ring_in The --ring-in argument or NULL
+ * @param ring_out The --ring-out argument or NULL
+ */
+static void exec_child(int which, char *ring_in, char *ring_out) {
+    char node_arg[32];
+    char *argv[sizeof(child_argv) / sizeof(*child_argv) + 3];
+    int n = 0;
+    while (child_argv[n] != NULL) {
+        argv[n] = child_argv[n];
+        n += 1;
     }
+    if (watch_enabled()) {
+        snprintf(node_arg, sizeof(node_arg), "--node=%ld", watch_child_node(which));
+        argv[n++] = node_arg;
+    }
+    if (ring_in != NULL) {
+        argv[n++] = ring_in;
+        argv[n++] = ring_out;
+    }
+    argv[n] = NULL;
+    execvp(pgm_name, argv);
+    error_exit("should not be reached");
+}
 
-    /* Read lines from stdin */
+/**
+ * Spawn ring child function
+ * @brief This function starts a child connected by two rings and copies the lines into its input ring.
+ * @details The child is this program started with --ring-in and --ring-out, the parent maps the other ends.
+ * The lines are freed.
+ * @param which The number of the child (0 or 1)
+ * @param lines The lines
+ * @param numlines The number of lines
+ * @param src The merge input that is connected to the output ring of the child
+ * @return The process id of the child
+ */
+static pid_t spawn_ring_child(int which, char **lines, int numlines, struct source *src) {
+    size_t bytes = 0;
+    for (int i = 0; i < numlines; i++) {
+        bytes += strlen(lines[i]);
+    }
+    size_t size = ring_size(bytes, numlines);
+    int in_fd = ring_create(size);
+    int out_fd = ring_create(size);
 
-    char *line = NULL;
-    int numlines = 0;
-    int arrlen = STEPSIZE;
-    char **lines = (char **) malloc(arrlen * sizeof(char *));
-    
-    size_t len = 0;
-    ssize_t read;
-    while ((read = getline(&line, &len, stdin)) != -1) {
-        if (read > max_buffer_size) {
-            max_buffer_size = read;
-        } 
-        lines[numlines] = line;
-        if (numlines == arrlen) {
-            arrlen += STEPSIZE;
-            char** newlines = realloc(lines, arrlen * sizeof(char *));
-            if (!newlines) {
-                error_exit("Unable to reallocate memory for lines");
+    pid_t pid = fork();
+    switch (pid) {
+        case -1:
+            error_exit("fork failed");
+        case 0: {
+            char in_arg[32], out_arg[32];
+            snprintf(in_arg, sizeof(in_arg), "--ring-in=%d", in_fd);
+            snprintf(out_arg, sizeof(out_arg), "--ring-out=%d", out_fd);
+            if (fcntl(in_fd, F_SETFD, 0) == -1 || fcntl(out_fd, F_SETFD, 0) == -1) {
+                error_exit("Could not pass rings to child");
             }
-            lines = newlines;
-        }   
+            exec_child(which, in_arg, out_arg);
+        }
+        default:
+            TRACE2(fork, depth, pid);
+            break;
+    }
 
-        numlines += 1;
-        line = NULL;
+    struct ring in;
+    ring_map(&in, in_fd, pid);
+    src->fd = -1;
+    ring_map(&src->ring, out_fd, pid);
+    close(in_fd);
+    close(out_fd);
+
+    TRACE3(input__start, depth, pid, numlines);
+    for (int i = 0; i < numlines; i++) {
+        ring_put(&in, lines[i], strlen(lines[i]));
+        free(lines[i]);
     }
+    ring_close(&in);
+    TRACE3(input__end, depth, pid, numlines);
+    return pid;
+}
 
-    if (numlines == 0) {
-        error_exit("No input given, cannot be sorted");
+/**
+ * Wait child function
+ * @brief This function waits for a child of the tree, accounts its resource usage and exits if it failed.
+ * @param pid The process id of the child
+ * @param name The name of the child in error messages
+ */
+static void wait_child(pid_t pid, const char *name) {
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) == -1) {
+        fprintf(stderr, "Error occured during waiting for child: %s (wait is -1)\n", name);
+        exit(EXIT_FAILURE);
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status) != EXIT_SUCCESS) {
+        fprintf(stderr, "Error occured during waiting for child: %s (exit status is not success)\n", name);
+        exit(EXIT_FAILURE);
     }
+    acct_add(depth + 1, &ru);
+}
 
+/**
+ * Forward usage function
+ * @brief This function writes the usage table of the subtree after the sorted lines: the number of levels and one line per level.
+ */
+static void forward_usage(void) {
+    char buf[256];
+    int count = acct_count();
+    for (int i = -1; i < count; i++) {
+        if (i == -1) {
+            snprintf(buf, sizeof(buf), "%d\n", count);
+        } else {
+            acct_format(i, buf, sizeof(buf));
+        }
+        if (out_ring != NULL) {
+            ring_put(out_ring, buf, strlen(buf));
+        } else if (fputs(buf, stdout) == EOF) {
+            error_exit("Could not write usage");
+        }
+    }
+}
+
+/**
+ * Sort lines function
+ * @brief This function sorts the lines and prints them to the output stream
+ * @details The lines are split in half and written to two child processes (this program, via fork and exec),
+ * the sorted halves are merged while the children write them and the children are reaped afterwards,
+ * so a child never blocks on a full pipe or ring its parent waits for. Subtrees with less than RING_MIN_DATA bytes
+ * use pipes, since setting up the rings would cost more than the copies they save. The lines are freed.
+ * @param lines The lines
+ * @param numlines The number of lines (at least 1)
+ */
+static void sort_lines(char **lines, int numlines) {
 	if (numlines == 1) {
         print(lines[0]);
-        exit(EXIT_SUCCESS);
+        free(lines[0]);
+        free(lines);
+        return;
     }
 
+    struct source src1, src2;
+    size_t bytes = 0;
+    for (int i = 0; rings && i < numlines && bytes < RING_MIN_DATA; i++) {
+        bytes += strlen(lines[i]);
+    }
+    if (rings && bytes >= RING_MIN_DATA) {
+        int half = numlines / 2;
+        watch_enter(WATCH_FEED, depth);
+        pid_t pid1 = spawn_ring_child(0, lines, half, &src1);
+        pid_t pid2 = spawn_ring_child(1, lines + half, numlines - half, &src2);
+        free(lines);
+        watch_enter(WATCH_MERGE, depth);
+        mergesort(&src1, &src2, half, numlines - half);
+        watch_enter(WATCH_REAP, depth);
+        wait_child(pid1, "pid1");
+        wait_child(pid2, "pid2");
+        return;
+    }
 
     /* Create Pipes and then fork() */
 
@@ -310,6 +795,7 @@ int main(int argc, char *argv[]) {
 
 	int wr_count1 = 0, wr_count2 = 0;
 	pid_t pid1, pid2;
+	watch_enter(WATCH_FEED, depth);
 	pid1 = fork();
 	switch (pid1) {
 		case -1:
@@ -333,15 +819,16 @@ int main(int argc, char *argv[]) {
 			close(wr_pipe_2[0]);
 			close(wr_pipe_2[1]);
 
-			execlp(pgm_name, pgm_name, NULL);
-        	error_exit("should not be reached");
+			exec_child(0, NULL, NULL);
 		default:
+			TRACE2(fork, depth, pid1);
 			close(rd_pipe_1[1]); 
 			close(wr_pipe_1[0]);
 			FILE *wr_file;
 			if ((wr_file = fdopen (wr_pipe_1[1], "w")) == NULL) {
 				error_exit("fdopen failed");
 			}
+			TRACE3(input__start, depth, pid1, numlines / 2);
 			for(int i = 0; i < numlines / 2; i++) {
 				if (fputs(lines[i], wr_file) == EOF) {
 					error_exit("Error writing into file");
@@ -351,6 +838,7 @@ int main(int argc, char *argv[]) {
     		}
 			fclose(wr_file);
 			close(wr_pipe_1[1]);
+			TRACE3(input__end, depth, pid1, wr_count1);
 	}    
 
 	pid2 = fork();
@@ -376,15 +864,16 @@ int main(int argc, char *argv[]) {
 			close(wr_pipe_1[0]);
 			close(wr_pipe_1[1]);
 
-			execlp(pgm_name, pgm_name, NULL);
-			error_exit("should not be reached");
+			exec_child(1, NULL, NULL);
 		default:
+			TRACE2(fork, depth, pid2);
 			close(rd_pipe_2[1]); 
 			close(wr_pipe_2[0]);
 			FILE *wr_file;
 			if ((wr_file = fdopen (wr_pipe_2[1], "w")) == NULL) {
 				error_exit("fdopen failed");
 			}
+			TRACE3(input__start, depth, pid2, numlines - wr_count1);
 			for(int i = wr_count1; i < numlines; i++) {
 				if (fputs(lines[i], wr_file) == EOF) {
 					error_exit("Error writing into file");
@@ -394,35 +883,711 @@ int main(int argc, char *argv[]) {
 			} 
 			fclose(wr_file);
 			close(wr_pipe_2[1]);
+			TRACE3(input__end, depth, pid2, wr_count2);
 	}
 
      // free resources
     free(lines);
-    free(line);
+
+
+    /* Merge parts and then wait for child processes */
+
+    source_open(&src1, rd_pipe_1[0]);
+    source_open(&src2, rd_pipe_2[0]);
+    watch_enter(WATCH_MERGE, depth);
+    mergesort(&src1, &src2, wr_count1, wr_count2);
+
+    watch_enter(WATCH_REAP, depth);
+    wait_child(pid1, "pid1");
+    wait_child(pid2, "pid2");
+}
+
+/**
+ * Compare pointers function
+ * @brief This function compares two lines of a line array for qsort().
+ */
+static int compare_ptr(const void *a, const void *b) {
+    return compare(*(char * const *) a, *(char * const *) b);
+}
+
+/**
+ * Sort small function
+ * @brief This function sorts a few lines in this process and prints them with a single write.
+ * @details For small inputs the fork and exec of about 2 * numlines processes takes far longer than the sort itself.
+ * The lines are sorted with qsort() and, if they are printed to stdout, collected in a static buffer that is large
+ * enough for all of them, so the output leaves with one write() when the stream is flushed. The lines are freed.
+ * @param lines The lines
+ * @param numlines The number of lines
+ */
+static void sort_small(char **lines, int numlines) {
+    static char buffer[SMALL_BUFFER_SIZE];
+    if (out == stdout && setvbuf(out, buffer, _IOFBF, sizeof(buffer)) != 0) {
+        error_exit("Could not set output buffer");
+    }
+    qsort(lines, numlines, sizeof(*lines), compare_ptr);
+    for (int i = 0; i < numlines; i++) {
+        print(lines[i]);
+        free(lines[i]);
+    }
+    free(lines);
+    if (out == stdout && fflush(out) == EOF) {
+        error_exit("Could not write output");
+    }
+}
+
+/**
+ * Sort memory function
+ * @brief This function sorts the lines in this process with memsort() or funnelsort() and prints them (--engine=mem|funnel).
+ * @param lines The lines
+ * @param numlines The number of lines
+ */
+static void sort_memory(char **lines, int numlines) {
+    if (engine == ENGINE_FUNNEL) {
+        comparisons += funnelsort(lines, numlines);
+    } else {
+        comparisons += memsort(lines, numlines, lanes);
+    }
+    for (int i = 0; i < numlines; i++) {
+        print(lines[i]);
+        free(lines[i]);
+    }
+    free(lines);
+}
+
+/**
+ * Build child arguments function
+ * @brief This function builds the arguments the children are started with: the internal options that describe the tree.
+ * @details Options that only concern the root (output, cache, index, ...) are not passed on.
+ * Must be called after the input was read, since it flushes the spill file of the long lines.
+ * @details global variables: child_argv, pgm_name
+ */
+static void build_child_argv(void) {
+    static char long_fd_arg[32];
+    static char depth_arg[32];
+    static char watch_fd_arg[32];
+    static char metrics_fd_arg[32];
+    int n = 0;
+
+    child_argv[n++] = pgm_name;
+    child_argv[n++] = "--child";
+    snprintf(depth_arg, sizeof(depth_arg), "--depth=%d", depth + 1);
+    child_argv[n++] = depth_arg;
+    if (longrec_fd() != -1) {
+        longrec_flush();
+        snprintf(long_fd_arg, sizeof(long_fd_arg), "--long-fd=%d", longrec_fd());
+        child_argv[n++] = long_fd_arg;
+    }
+    if (!rings) {
+        child_argv[n++] = "--transport=pipe";
+    }
+    if (rusage) {
+        child_argv[n++] = "--rusage";
+    }
+    if (watch_fd != -1) {
+        snprintf(watch_fd_arg, sizeof(watch_fd_arg), "--watch-fd=%d", watch_fd);
+        child_argv[n++] = watch_fd_arg;
+    }
+    if (metrics_fd != -1) {
+        snprintf(metrics_fd_arg, sizeof(metrics_fd_arg), "--metrics-fd=%d", metrics_fd);
+        child_argv[n++] = metrics_fd_arg;
+    }
+    child_argv[n] = NULL;
+}
+
+/**
+ * Positional sort function
+ * @brief This function sorts the lines into a regular output file with one worker per key range.
+ * @details The lines are range partitioned, so the size of every range and therefore its offset in the output is known in advance.
+ * The output is preallocated and every worker (a fork of this process) sorts its range with the usual process tree and
+ * writes the merged lines directly to its offset with pwrite(), so the output is written by all workers in parallel.
+ * A range that holds only copies of a heavy line is written without sorting.
+ * The lines are freed.
+ * @param lines The lines, each ending with a newline
+ * @param numlines The number of lines
+ * @param fd The file descriptor of the output file
+ * @param jobs The number of workers
+ * @param direct true if the workers write with O_DIRECT
+ */
+static void sort_lines_positional(char **lines, int numlines, int fd, int jobs, bool direct) {
+    struct partition part;
+    partition_lines(lines, numlines, jobs, printed_size, &part);
+
+    off_t total = 0;
+    for (size_t b = 0; b < part.buckets; b++) {
+        total += part.sizes[b];
+    }
+    if (total > 0 && fallocate(fd, 0, 0, total) == -1 && ftruncate(fd, total) == -1) {
+        error_exit("Could not preallocate output file");
+    }
+
+    fflush(NULL);
+    off_t offset = 0;
+    int workers = 0;
+    for (size_t b = 0; b < part.buckets; b++) {
+        if (part.counts[b] == 0) {
+            continue;
+        }
+        switch (fork()) {
+            case -1:
+                error_exit("fork of positional worker failed");
+            case 0:
+                if ((out = dio_open(fd, offset, direct)) == NULL) {
+                    error_exit("Could not open positional writer");
+                }
+                if (part.uniform[b]) {
+                    // copies of one heavy line, already in order
+                    for (int i = 0; i < part.counts[b]; i++) {
+                        print(part.lines[b][i]);
+                    }
+                } else {
+                    if (engine != ENGINE_TREE) {
+                        sort_memory(part.lines[b], part.counts[b]);
+                    } else {
+                        sort_lines(part.lines[b], part.counts[b]);
+                    }
+                }
+                if (fclose(out) == EOF) {
+                    error_exit("Could not write output file");
+                }
+                metrics_node(comparisons);
+                exit(EXIT_SUCCESS);
+            default:
+                workers += 1;
+        }
+        offset += part.sizes[b];
+    }
+
+    int status;
+    for (int i = 0; i < workers; i++) {
+        if (wait(&status) == -1) {
+            error_exit("Error occured during waiting for positional worker");
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            error_exit("Error occured during waiting for positional worker (exit status is not success)");
+        }
+    }
+
+    for (int i = 0; i < numlines; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+    partition_free(&part);
+}
+
+int main(int argc, char *argv[]) {
+    pgm_name = argv[0];
+    out = stdout;
+
+    if (argc > 1 && strcmp(argv[1], "lookup") == 0) {
+        exit(index_lookup_main(argc - 1, argv + 1));
+    }
+
+    // "store add" sorts its input like a plain run, every other store command is handled by the store
+    struct store store = { .dir = NULL, .policy = STORE_TIERED, .direct = false, .tmp_path = NULL, .tmp_fd = -1 };
+    bool store_add = argc > 2 && strcmp(argv[1], "store") == 0 && strcmp(argv[2], "add") == 0;
+    if (store_add) {
+        argc -= 2;
+        argv += 2;
+    } else if (argc > 1 && strcmp(argv[1], "store") == 0) {
+        exit(store_main(argc - 1, argv + 1));
+    }
+
+    static const struct option long_options[] = {
+        { "cache", required_argument, NULL, 'c' },
+        { "cache-size", required_argument, NULL, 'C' },
+        { "index", required_argument, NULL, 'i' },
+        { "index-block", required_argument, NULL, 'I' },
+        { "policy", required_argument, NULL, 'p' },
+        { "in-place", required_argument, NULL, 'P' },
+        { "record-size", required_argument, NULL, 'r' },
+        { "jobs", required_argument, NULL, 'j' },
+        { "output", required_argument, NULL, 'o' },
+        { "direct-io", no_argument, NULL, 'd' },
+        { "long-threshold", required_argument, NULL, 'l' },
+        { "compress-keys", no_argument, NULL, 'k' },
+        { "child", no_argument, NULL, 'X' },
+        { "long-fd", required_argument, NULL, 'L' },
+        { "transport", required_argument, NULL, 'T' },
+        { "ring-in", required_argument, NULL, 'R' },
+        { "ring-out", required_argument, NULL, 'W' },
+        { "depth", required_argument, NULL, 'D' },
+        { "rusage", no_argument, NULL, 'u' },
+        { "watchdog", required_argument, NULL, 'g' },
+        { "watch-fd", required_argument, NULL, 'F' },
+        { "node", required_argument, NULL, 'N' },
+        { "metrics-file", required_argument, NULL, 'M' },
+        { "small-threshold", required_argument, NULL, 's' },
+        { "engine", required_argument, NULL, 'E' },
+        { "paragraph", no_argument, NULL, 'a' },
+        { "plugin", required_argument, NULL, 'x' },
+        { "columnar", required_argument, NULL, 'K' },
+        { "key-expr", required_argument, NULL, 'e' },
+        { "field-separator", required_argument, NULL, 't' },
+        { "output-fields", required_argument, NULL, 'f' },
+        { "where", required_argument, NULL, 'w' },
+        { "record-start", required_argument, NULL, 'S' },
+        { "interleave", required_argument, NULL, 'n' },
+        { "metrics-fd", required_argument, NULL, 'm' },
+        { NULL, 0, NULL, 0 }
+    };
+    struct cache cache = { .dir = NULL, .limit = DEFAULT_CACHE_SIZE, .tmp_path = NULL, .tmp_fd = -1 };
+    const char *index_path = NULL;
+    off_t index_block = INDEX_DEFAULT_BLOCK;
+    const char *inplace_path = NULL;
+    const char *columnar_keys = NULL;
+    size_t record_size = 0;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *output_path = NULL;
+    bool direct_io = false;
+    size_t long_threshold = DEFAULT_LONG_THRESHOLD;
+    bool compress_keys = false;
+    struct ring in_ring_end, out_ring_end;
+    struct ring *in_ring = NULL;
+    unsigned watchdog = 0;
+    long watch_node = 1;
+    const char *metrics_path = NULL;
+    long small_threshold = DEFAULT_SMALL_THRESHOLD;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'c':
+                cache.dir = optarg;
+                break;
+            case 'C':
+                cache.limit = parse_size(optarg);
+                break;
+            case 'i':
+                index_path = optarg;
+                break;
+            case 'I':
+                if ((index_block = parse_size(optarg)) == 0) {
+                    usage();
+                }
+                break;
+            case 'P':
+                inplace_path = optarg;
+                break;
+            case 'K':
+                columnar_keys = optarg;
+                break;
+            case 'e':
+                key_source = optarg;
+                break;
+            case 't':
+                if (!field_set_separator(optarg)) {
+                    usage();
+                }
+                break;
+            case 'f':
+                if (!field_set_projection(optarg)) {
+                    usage();
+                }
+                break;
+            case 'w': {
+                const char *where_error;
+                if (!where_add(optarg, &where_error)) {
+                    fprintf(stderr, "%s: invalid filter '%s': %s\n", pgm_name, optarg, where_error);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            }
+            case 'r':
+                if ((record_size = parse_size(optarg)) == 0) {
+                    usage();
+                }
+                break;
+            case 'j':
+                if ((jobs = parse_size(optarg)) == 0) {
+                    usage();
+                }
+                break;
+            case 'o':
+                output_path = optarg;
+                break;
+            case 'd':
+                direct_io = true;
+                break;
+            case 'l':
+                long_threshold = parse_size(optarg);
+                break;
+            case 'k':
+                compress_keys = true;
+                break;
+            case 'X':
+                child = true;
+                break;
+            case 'L':
+                longrec_attach(atoi(optarg));
+                break;
+            case 'T':
+                if (strcmp(optarg, "ring") == 0) {
+                    rings = true;
+                } else if (strcmp(optarg, "pipe") == 0) {
+                    rings = false;
+                } else {
+                    usage();
+                }
+                break;
+            case 'D':
+                depth = atoi(optarg);
+                break;
+            case 'u':
+                rusage = true;
+                break;
+            case 'g':
+                if ((watchdog = parse_size(optarg)) == 0) {
+                    usage();
+                }
+                break;
+            case 'F':
+                watch_fd = atoi(optarg);
+                break;
+            case 'N':
+                watch_node = atol(optarg);
+                break;
+            case 'M':
+                metrics_path = optarg;
+                break;
+            case 'a':
+                record_paragraph_mode();
+                break;
+            case 'x':
+                plugin_path = optarg;
+                break;
+            case 'S':
+                record_start_mode(optarg);
+                break;
+            case 'E':
+                if (strcmp(optarg, "tree") == 0) {
+                    engine = ENGINE_TREE;
+                } else if (strcmp(optarg, "mem") == 0) {
+                    engine = ENGINE_MEM;
+                } else if (strcmp(optarg, "funnel") == 0) {
+                    engine = ENGINE_FUNNEL;
+                } else {
+                    usage();
+                }
+                break;
+            case 'n':
+                lanes = parse_size(optarg);
+                if (lanes < 1 || lanes > MEMSORT_MAX_LANES) {
+                    usage();
+                }
+                break;
+            case 's':
+                small_threshold = parse_size(optarg);
+                break;
+            case 'm':
+                metrics_fd = atoi(optarg);
+                metrics_attach(metrics_fd);
+                break;
+            case 'R':
+                in_ring = &in_ring_end;
+                ring_map(in_ring, atoi(optarg), getppid());
+                close(atoi(optarg));
+                break;
+            case 'W':
+                out_ring = &out_ring_end;
+                ring_map(out_ring, atoi(optarg), getppid());
+                close(atoi(optarg));
+                break;
+            case 'p':
+                if (!store_add || !store_parse_policy(optarg, &store.policy)) {
+                    usage();
+                }
+                break;
+            default:
+                usage();
+        }
+    }
+
+    if (store_add) {
+        if (optind != argc - 1 || cache.dir != NULL || index_path != NULL || output_path != NULL) {
+            usage();
+        }
+        store.dir = argv[optind];
+    } else if (optind != argc) {
+        usage();
+    }
+
+    if (watch_fd != -1) {
+        watch_attach(watch_fd, watch_node);
+        watch_enter(WATCH_READ, depth);
+    }
+    if (!child && metrics_path != NULL) {
+        metrics_fd = metrics_create();
+        metrics_begin(METRICS_READ);
+    }
+
+    bool keyed = plugin_path != NULL || key_source != NULL;
+    if ((record_active() || keyed) && (store_add || index_path != NULL || inplace_path != NULL)) {
+        // runs and the sparse index are line based and in byte order
+        usage();
+    }
+    if ((plugin_path != NULL && key_source != NULL) || (field_projecting() && (record_active() || inplace_path != NULL))) {
+        // the fields of a multi-line record are not projected
+        usage();
+    }
+    if (plugin_path != NULL) {
+        plugin_load(plugin_path);
+    }
+    struct keyexpr *key_expr = NULL;
+    if (key_source != NULL) {
+        const char *key_error;
+        size_t key_error_pos;
+        if ((key_expr = keyexpr_compile(key_source, &key_error, &key_error_pos)) == NULL) {
+            fprintf(stderr, "%s: invalid key expression at offset %zu: %s\n", pgm_name, key_error_pos, key_error);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (inplace_path != NULL) {
+        if (record_size == 0 || store_add || cache.dir != NULL || index_path != NULL || columnar_keys != NULL) {
+            usage();
+        }
+        inplace_sort(inplace_path, record_size, jobs);
+        exit(EXIT_SUCCESS);
+    }
+    if (columnar_keys != NULL) {
+        // the stream is sorted by the in-place engine, the line options do not apply
+        if (store_add || cache.dir != NULL || index_path != NULL || output_path != NULL || record_active() ||
+            keyed || compress_keys || field_projecting() || where_active()) {
+            usage();
+        }
+        columnar_sort(stdin, stdout, columnar_keys, jobs);
+        exit(EXIT_SUCCESS);
+    }
+
+    /* Read lines from stdin */
+
+    struct cache_hash hash;
+    cache_hash_init(&hash);
+
+    char *line = NULL;
+    int numlines = 0;
+    int arrlen = STEPSIZE;
+    char **lines = (char **) malloc(arrlen * sizeof(char *));
     
+    size_t len = 0;
+    ssize_t read;
+    uint64_t input_bytes = 0;
+    uint64_t rejected = 0;
+    while ((read = !child && record_active() ? record_read(stdin, &line, &len) : read_input(in_ring, &line, &len)) != -1) {
+        if (read > max_buffer_size) {
+            max_buffer_size = read;
+        } 
+        input_bytes += read;
+        watch_tick();
+        if (cache.dir != NULL) {
+            cache_hash_update(&hash, line, read);
+        }
+        if (!child && where_active() && !where_match(line, read)) {
+            // the read buffer is reused for the next record
+            rejected += 1;
+            continue;
+        }
+        if (numlines == arrlen) {
+            arrlen += STEPSIZE;
+            char** newlines = realloc(lines, arrlen * sizeof(char *));
+            if (!newlines) {
+                error_exit("Unable to reallocate memory for lines");
+            }
+            lines = newlines;
+        }   
+        if (line[read - 1] != '\n') {
+            // every line ends with a newline, so all lines compare alike
+            char *terminated = realloc(line, read + 2);
+            if (!terminated) {
+                error_exit("Unable to reallocate memory for line");
+            }
+            terminated[read] = '\n';
+            terminated[read + 1] = '\0';
+            line = terminated;
+            read += 1;
+        }
+        if (key_expr != NULL) {
+            // the tree sorts the records by their keys, the root strips the keys when it prints them
+            size_t keyed_len = read;
+            line = keyexpr_line(key_expr, line, &keyed_len);
+            read = keyed_len;
+        } else if (!child && field_projecting()) {
+            // only the kept fields travel through the tree
+            size_t projected_len = read;
+            line = field_project_line(line, &projected_len);
+            read = projected_len;
+        }
+        // with compression or plugin keys, lines are stored out-of-line after they are encoded
+        if (!child && !compress_keys && plugin_path == NULL && long_threshold > 0 && ((size_t) read > long_threshold || line[0] == LONGREC_MARK)) {
+            line = longrec_store(line, read);
+        }
+        lines[numlines] = line;
 
-    /* Wait for child processes and then merge parts */
-	
-	int status1, status2;
-	if (waitpid(pid1, &status1, 0) == -1) { 
-		error_exit("Error occured during waiting for child: pid1 (wait is -1)");
-	}
-    if (WIFEXITED(status1)) {
-        if (WEXITSTATUS(status1) != EXIT_SUCCESS) {
-            error_exit("Error occured during waiting for child: pid1 (exit status is not success)");
+        numlines += 1;
+        line = NULL;
+    }
+    free(line);
+    if (in_ring != NULL) {
+        ring_unmap(in_ring);
+    }
+
+    if (numlines == 0 && rejected > 0) {
+        // every record was filtered out, so the output is empty
+        if (output_path != NULL && open(output_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666) == -1) {
+            error_exit("Could not open output file");
         }
+        exit(EXIT_SUCCESS);
     }
+    if (numlines == 0) {
+        error_exit("No input given, cannot be sorted");
+    }
+    TRACE2(node__start, depth, numlines);
 
-	if (waitpid(pid2, &status2, 0) == -1) {
-		error_exit("Error occured during waiting for child: pid2 (wait is -1)");
-	}
-    if (WIFEXITED(status2)) {
-        if (WEXITSTATUS(status2) != EXIT_SUCCESS) {
-            error_exit("Error occured during waiting for child: pid2 (exit status is not success)");
+    pid_t watchdog_pid = -1;
+    if (!child && watchdog > 0) {
+        watch_fd = watch_create(numlines);
+        watchdog_pid = watch_start(watchdog);
+    }
+
+    if (plugin_path != NULL) {
+        // the tree sorts the lines by their keys, the root strips the keys when it prints them
+        plugin_keys(lines, numlines);
+    }
+    if (compress_keys) {
+        // the tree sorts the encoded lines, the root decodes them when it prints them
+        keycode_build(lines, numlines);
+    }
+    if (compress_keys || plugin_path != NULL) {
+        for (int i = 0; i < numlines; i++) {
+            size_t enclen = strlen(lines[i]);
+            if (compress_keys) {
+                lines[i] = keycode_encode(lines[i], &enclen);
+            }
+            if (long_threshold > 0 && enclen > long_threshold) {
+                lines[i] = longrec_store(lines[i], enclen);
+            }
+        }
+    }
+
+    if (!child && rings) {
+        // a line that does not fit into half a ring goes through pipes
+        for (int i = 0; i < numlines && rings; i++) {
+            rings = strlen(lines[i]) <= RING_MAX_SIZE / 2 - 16;
+        }
+    }
+    build_child_argv();
+
+    int out_fd = STDOUT_FILENO;
+    if (output_path != NULL && (out_fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) == -1) {
+        error_exit("Could not open output file");
+    }
+    if (index_path != NULL) {
+        out_index = index_create(index_path, index_block);
+    }
+
+    /* Serve the output from the cache or sort into a new cache entry */
+
+    if (cache.dir != NULL) {
+        hash_options(&hash);
+        cache_hash_final(&hash, cache.key);
+        int hit = cache_lookup(&cache);
+        if (hit != -1) {
+            copy_fd(hit, out_fd);
+            if (out_index != NULL) {
+                index_scan_fd(out_index, hit);
+                index_close(out_index);
+            }
+            if (metrics_path != NULL) {
+                metrics_node(0);
+                metrics_write(metrics_path, input_bytes, numlines, longrec_spilled());
+            }
+            exit(EXIT_SUCCESS);
+        }
+        if (cache_store_begin(&cache) != -1) {
+            FILE *entry = dio_open(cache.tmp_fd, 0, direct_io);
+            if (entry != NULL) {
+                out = entry;
+            } else {
+                cache_store_abort(&cache);
+            }
+        }
+    }
+
+    if (store.dir != NULL) {
+        store.direct = direct_io;
+        if ((out = dio_open(store_add_begin(&store), 0, direct_io)) == NULL) {
+            error_exit("Could not open run");
+        }
+    }
+
+    // a regular output file is written at precomputed offsets by parallel workers
+    struct stat out_stat;
+    bool regular = output_path != NULL && fstat(out_fd, &out_stat) == 0 && S_ISREG(out_stat.st_mode);
+    bool positional = regular && cache.tmp_fd == -1 && out_index == NULL && !rusage && watchdog == 0 && jobs > 1 && numlines >= 2 * jobs;
+    // a small input is sorted by the root alone, unless the tree itself is observed
+    bool small = !child && !positional && numlines <= small_threshold && input_bytes + numlines <= SMALL_BUFFER_SIZE && !rusage && watchdog == 0;
+    if (output_path != NULL && !positional && cache.tmp_fd == -1) {
+        out = regular ? dio_open(out_fd, 0, direct_io) : fdopen(out_fd, "w");
+        if (out == NULL) {
+            error_exit("Could not open output file");
         }
     }
 
-    mergesort(rd_pipe_1[0], rd_pipe_2[0], wr_count1, wr_count2);
+    TRACE2(output__start, depth, numlines);
+    if (metrics_path != NULL) {
+        metrics_begin(METRICS_SORT);
+    }
+    if (positional) {
+        sort_lines_positional(lines, numlines, out_fd, jobs, direct_io);
+    } else if (engine != ENGINE_TREE) {
+        sort_memory(lines, numlines);
+    } else if (small) {
+        sort_small(lines, numlines);
+    } else {
+        sort_lines(lines, numlines);
+    }
+    if (child && rusage) {
+        forward_usage();
+    }
+    if (out_ring != NULL) {
+        ring_close(out_ring);
+    }
+    if (child && fflush(stdout) == EOF) {
+        error_exit("Could not write output");
+    }
+    TRACE2(output__end, depth, numlines);
+    if (metrics_path != NULL) {
+        metrics_begin(METRICS_FINISH);
+    }
+
+    if (out != stdout && fclose(out) == EOF) {
+        error_exit("Could not write output");
+    }
+    if (store.dir != NULL) {
+        store_add_commit(&store);
+    }
+    if (cache.tmp_fd != -1) {
+        cache_store_commit(&cache);
+        if (lseek(cache.tmp_fd, 0, SEEK_SET) == -1) {
+            error_exit("Could not rewind cache entry");
+        }
+        copy_fd(cache.tmp_fd, out_fd);
+        close(cache.tmp_fd);
+    }
+    if (out_index != NULL) {
+        index_close(out_index);
+    }
+    if (!child && rusage) {
+        acct_print(stderr);
+    }
+    watch_enter(WATCH_DONE, depth);
+    if (watchdog_pid != -1) {
+        watch_stop(watchdog_pid);
+    }
+    metrics_node(comparisons);
+    if (metrics_path != NULL) {
+        metrics_write(metrics_path, input_bytes, numlines, longrec_spilled());
+    }
 
+    TRACE2(node__exit, depth, numlines);
 	exit(EXIT_SUCCESS);
 }
\ No newline at end of file
@@ -0,0 +1,94 @@
+/**
+ * @file memsort.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief In-memory merge sort of a line array with interleaved merges (--engine=mem).
+ *
+ * The sort is bottom-up: runs of RUN_LENGTH lines are sorted by insertion, then every level merges pairs of runs from
+ * one pointer array into the other. The merges of a level are cut into segments; a level with fewer pairs than lanes
+ * cuts each merge along its merge path (co-ranking), so even the last level keeps all lanes busy.
+ * Every lane takes one line per turn and prefetches the line it compares next, which is needed only after the other
+ * lanes took their turn.
+ *
+ * The kernels are instantiated from memsort_kernel.h once per line layout, so the comparison is inlined into every
+ * loop: _plain compares with strcmp() when no line is stored out-of-line, _ref with longrec_cmp() otherwise.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "memsort.h"
+#include "longrec.h"
+
+/** Defines the length of the runs that are sorted by insertion before merging. */
+#define RUN_LENGTH 8
+
+/** A part of a merge: the lines of both runs that end up in out, in order. */
+struct segment {
+    char **a, **a_end;
+    char **b, **b_end;
+    char **out;
+};
+
+/** The merges of one level, handed out segment by segment. */
+struct level {
+    char **src, **dst;
+    size_t numlines, width;
+    size_t pair, pairs;
+    size_t piece, pieces;
+};
+
+/** The number of comparisons of the current sort. */
+static uint64_t comparisons;
+
+static void prefetch(char **line, char **end) {
+    if (line < end) {
+        __builtin_prefetch(*line);
+    }
+}
+
+#define KERNEL(name) name##_plain
+#define KERNEL_CMP(a, b) (comparisons++, strcmp(a, b))
+#include "memsort_kernel.h"
+
+#define KERNEL(name) name##_ref
+#define KERNEL_CMP(a, b) (comparisons++, longrec_cmp(a, b))
+#include "memsort_kernel.h"
+
+/**
+ * Memsort function
+ * @brief This function sorts a line array in memory in the order of longrec_cmp().
+ * @param lines The lines
+ * @param numlines The number of lines
+ * @param lanes The number of merges that are interleaved (1 merges one segment after the other)
+ * @return The number of comparisons
+ */
+uint64_t memsort(char **lines, size_t numlines, unsigned lanes) {
+    if (lanes < 1) {
+        lanes = 1;
+    } else if (lanes > MEMSORT_MAX_LANES) {
+        lanes = MEMSORT_MAX_LANES;
+    }
+    comparisons = 0;
+    if (numlines <= RUN_LENGTH) {
+        insertion_sort_ref(lines, numlines);
+        return comparisons;
+    }
+
+    char **tmp = malloc(numlines * sizeof(*tmp));
+    if (tmp == NULL) {
+        fprintf(stderr, "memsort: Unable to allocate memory for lines\n");
+        exit(EXIT_FAILURE);
+    }
+    if (longrec_fd() == -1) {
+        // without a spill file there are no references
+        sort_plain(lines, tmp, numlines, lanes);
+    } else {
+        sort_ref(lines, tmp, numlines, lanes);
+    }
+    free(tmp);
+    return comparisons;
+}
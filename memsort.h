@@ -0,0 +1,27 @@
+/**
+ * @file memsort.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief In-memory merge sort of a line array with interleaved merges (--engine=mem).
+ *
+ * A merge over pointer arrays stalls on a cache miss whenever it dereferences the next line to compare it.
+ * The sort runs the merges of a level as independent lanes on one core, one step of every lane in turn, and prefetches
+ * the line a lane compares next, so the misses of all lanes overlap instead of being waited for one after another.
+ **/
+
+#ifndef MEMSORT_H
+#define MEMSORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Defines the default number of merges that are interleaved. */
+#define MEMSORT_DEFAULT_LANES 8
+
+/** Defines the maximum number of merges that are interleaved. */
+#define MEMSORT_MAX_LANES 64
+
+uint64_t memsort(char **lines, size_t numlines, unsigned lanes);
+
+#endif
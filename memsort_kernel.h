@@ -0,0 +1,153 @@
+/**
+ * @file memsort_kernel.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Template of the leaf sort and merge kernels of memsort(), included once per line layout.
+ *
+ * Before every inclusion memsort.c defines
+ *   KERNEL(name)   the name of a function of this instance, e.g. name##_plain,
+ *   KERNEL_CMP(a, b) the order of two lines, an expression the compiler inlines into the loops.
+ * Both are undefined at the end, so the next instance can define them again.
+ **/
+
+static void KERNEL(insertion_sort)(char **lines, size_t n) {
+    for (size_t i = 1; i < n; i++) {
+        char *line = lines[i];
+        size_t j = i;
+        while (j > 0 && KERNEL_CMP(lines[j - 1], line) > 0) {
+            lines[j] = lines[j - 1];
+            j--;
+        }
+        lines[j] = line;
+    }
+}
+
+/**
+ * Co-rank function
+ * @brief This function finds the number of lines of run a among the first d lines of the merge of a and b.
+ * @details Equal lines are taken from a first, like the merge does.
+ */
+static size_t KERNEL(co_rank)(size_t d, char **a, size_t m, char **b, size_t n) {
+    size_t lo = d > n ? d - n : 0;
+    size_t hi = d < m ? d : m;
+    while (lo < hi) {
+        size_t i = lo + (hi - lo) / 2;
+        if (KERNEL_CMP(a[i], b[d - i - 1]) <= 0) {
+            lo = i + 1;
+        } else {
+            hi = i;
+        }
+    }
+    return lo;
+}
+
+/**
+ * Next segment function
+ * @brief This function hands out the next segment of the level.
+ * @return false if the level has no segments left
+ */
+static bool KERNEL(next_segment)(struct level *lv, struct segment *seg) {
+    if (lv->pair == lv->pairs) {
+        return false;
+    }
+    size_t start = lv->pair * 2 * lv->width;
+    size_t mid = start + lv->width < lv->numlines ? start + lv->width : lv->numlines;
+    size_t end = mid + lv->width < lv->numlines ? mid + lv->width : lv->numlines;
+    char **a = lv->src + start, **b = lv->src + mid;
+    size_t m = mid - start, n = end - mid;
+
+    size_t pieces = n == 0 ? 1 : lv->pieces;
+    size_t d_lo = (m + n) * lv->piece / pieces;
+    size_t d_hi = (m + n) * (lv->piece + 1) / pieces;
+    size_t i_lo = pieces == 1 ? 0 : KERNEL(co_rank)(d_lo, a, m, b, n);
+    size_t i_hi = pieces == 1 ? m : KERNEL(co_rank)(d_hi, a, m, b, n);
+
+    seg->a = a + i_lo;
+    seg->a_end = a + i_hi;
+    seg->b = b + (d_lo - i_lo);
+    seg->b_end = b + (d_hi - i_hi);
+    seg->out = lv->dst + start + d_lo;
+
+    if (++lv->piece == pieces) {
+        lv->piece = 0;
+        lv->pair += 1;
+    }
+    return true;
+}
+
+/**
+ * Step function
+ * @brief This function moves the smaller head line of a segment to its output and prefetches the line behind it.
+ * @return false if the segment is done
+ */
+static bool KERNEL(step)(struct segment *seg) {
+    if (seg->a == seg->a_end || seg->b == seg->b_end) {
+        char **rest = seg->a == seg->a_end ? seg->b : seg->a;
+        char **rest_end = seg->a == seg->a_end ? seg->b_end : seg->a_end;
+        memcpy(seg->out, rest, (rest_end - rest) * sizeof(*rest));
+        return false;
+    }
+    if (KERNEL_CMP(*seg->a, *seg->b) <= 0) {
+        *seg->out++ = *seg->a++;
+        prefetch(seg->a, seg->a_end);
+    } else {
+        *seg->out++ = *seg->b++;
+        prefetch(seg->b, seg->b_end);
+    }
+    return true;
+}
+
+/**
+ * Merge level function
+ * @brief This function merges all pairs of runs of the given width from src into dst, with up to lanes segments at once.
+ */
+static void KERNEL(merge_level)(char **src, char **dst, size_t numlines, size_t width, unsigned lanes) {
+    struct level lv = { .src = src, .dst = dst, .numlines = numlines, .width = width, .pair = 0, .piece = 0 };
+    lv.pairs = (numlines + 2 * width - 1) / (2 * width);
+    lv.pieces = lv.pairs < lanes ? (lanes + lv.pairs - 1) / lv.pairs : 1;
+
+    struct segment lane[MEMSORT_MAX_LANES];
+    unsigned active = 0;
+    while (active < lanes && KERNEL(next_segment)(&lv, &lane[active])) {
+        prefetch(lane[active].a, lane[active].a_end);
+        prefetch(lane[active].b, lane[active].b_end);
+        active++;
+    }
+    while (active > 0) {
+        for (unsigned l = 0; l < active;) {
+            if (KERNEL(step)(&lane[l])) {
+                l++;
+            } else if (KERNEL(next_segment)(&lv, &lane[l])) {
+                prefetch(lane[l].a, lane[l].a_end);
+                prefetch(lane[l].b, lane[l].b_end);
+                l++;
+            } else {
+                lane[l] = lane[--active];
+            }
+        }
+    }
+}
+
+/**
+ * Sort function
+ * @brief This function sorts runs by insertion and merges them level by level, tmp is scratch space for as many lines.
+ */
+static void KERNEL(sort)(char **lines, char **tmp, size_t numlines, unsigned lanes) {
+    for (size_t i = 0; i < numlines; i += RUN_LENGTH) {
+        KERNEL(insertion_sort)(lines + i, numlines - i < RUN_LENGTH ? numlines - i : RUN_LENGTH);
+    }
+    char **src = lines, **dst = tmp;
+    for (size_t width = RUN_LENGTH; width < numlines; width *= 2) {
+        KERNEL(merge_level)(src, dst, numlines, width, lanes);
+        char **swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != lines) {
+        memcpy(lines, src, numlines * sizeof(*lines));
+    }
+}
+
+#undef KERNEL
+#undef KERNEL_CMP
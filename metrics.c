@@ -0,0 +1,192 @@
+/**
+ * @file metrics.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Run summary in the OpenMetrics text format (--metrics-file).
+ *
+ * The CPU time of a phase is the time of the root and of the children it reaped during the phase, the children of the
+ * tree are all reaped when the sort phase ends.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "metrics.h"
+
+/** The counters of the tree, shared by all nodes. */
+struct metrics_shared {
+    uint64_t processes;
+    uint64_t comparisons;
+};
+
+static struct metrics_shared *shared = NULL;
+
+static const char *phase_names[METRICS_PHASES] = { "read", "sort", "finish" };
+static double wall[METRICS_PHASES], cpu[METRICS_PHASES];
+static int current = -1;
+static double phase_wall, phase_cpu;
+
+static void metrics_error(const char *msg) {
+    fprintf(stderr, "metrics: %s: %s\n", msg, strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+static void map_shared(int fd) {
+    shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shared == MAP_FAILED) {
+        metrics_error("could not map counters");
+    }
+}
+
+/**
+ * Metrics create function
+ * @brief This function creates the shared counters of the tree.
+ * @return The file descriptor of the counters, inherited by the children
+ */
+int metrics_create(void) {
+    int fd = memfd_create("forksort-metrics", 0);
+    if (fd == -1 || ftruncate(fd, sizeof(*shared)) == -1) {
+        metrics_error("could not create counters");
+    }
+    map_shared(fd);
+    return fd;
+}
+
+void metrics_attach(int fd) {
+    map_shared(fd);
+}
+
+bool metrics_enabled(void) {
+    return shared != NULL;
+}
+
+/**
+ * Metrics node function
+ * @brief This function adds a finished node and its comparisons to the counters of the tree.
+ * @param comparisons The number of lines comparisons of the node
+ */
+void metrics_node(uint64_t comparisons) {
+    if (shared != NULL) {
+        __atomic_add_fetch(&shared->processes, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&shared->comparisons, comparisons, __ATOMIC_RELAXED);
+    }
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_seconds(void) {
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    return self.ru_utime.tv_sec + self.ru_utime.tv_usec / 1e6 + self.ru_stime.tv_sec + self.ru_stime.tv_usec / 1e6
+            + children.ru_utime.tv_sec + children.ru_utime.tv_usec / 1e6
+            + children.ru_stime.tv_sec + children.ru_stime.tv_usec / 1e6;
+}
+
+/**
+ * Metrics begin function
+ * @brief This function ends the current phase of the root and begins the next one.
+ * @param phase The next phase, METRICS_PHASES only ends the current one
+ */
+void metrics_begin(enum metrics_phase phase) {
+    double w = now(), c = cpu_seconds();
+    if (current >= 0) {
+        wall[current] += w - phase_wall;
+        cpu[current] += c - phase_cpu;
+    }
+    current = phase < METRICS_PHASES ? (int) phase : -1;
+    phase_wall = w;
+    phase_cpu = c;
+}
+
+static void metric(FILE *f, const char *name, const char *type, const char *unit, const char *help) {
+    fprintf(f, "# TYPE %s %s\n", name, type);
+    if (unit != NULL) {
+        fprintf(f, "# UNIT %s %s\n", name, unit);
+    }
+    fprintf(f, "# HELP %s %s\n", name, help);
+}
+
+/**
+ * Metrics write function
+ * @brief This function ends the current phase and atomically replaces the metrics file with the summary of the run.
+ * @param path The metrics file
+ * @param bytes The number of input bytes
+ * @param records The number of input lines
+ * @param spilled The number of bytes of long lines stored out-of-line
+ */
+void metrics_write(const char *path, uint64_t bytes, uint64_t records, off_t spilled) {
+    metrics_begin(METRICS_PHASES);
+
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    long peak = self.ru_maxrss > children.ru_maxrss ? self.ru_maxrss : children.ru_maxrss;
+    double total = 0;
+    for (int p = 0; p < METRICS_PHASES; p++) {
+        total += wall[p];
+    }
+
+    size_t len = strlen(path);
+    char *tmp_path = malloc(len + sizeof(".tmp.XXXXXX"));
+    if (tmp_path == NULL) {
+        metrics_error("out of memory");
+    }
+    memcpy(tmp_path, path, len);
+    memcpy(tmp_path + len, ".tmp.XXXXXX", sizeof(".tmp.XXXXXX"));
+    int fd = mkostemp(tmp_path, O_CLOEXEC);
+    FILE *f;
+    if (fd == -1 || fchmod(fd, 0644) == -1 || (f = fdopen(fd, "w")) == NULL) {
+        metrics_error(tmp_path);
+    }
+
+    metric(f, "forksort_input_bytes", "gauge", "bytes", "Bytes read from the input.");
+    fprintf(f, "forksort_input_bytes %llu\n", (unsigned long long) bytes);
+    metric(f, "forksort_input_records", "gauge", NULL, "Lines read from the input.");
+    fprintf(f, "forksort_input_records %llu\n", (unsigned long long) records);
+    metric(f, "forksort_phase_wall_seconds", "gauge", "seconds", "Wall time of a phase of the run.");
+    for (int p = 0; p < METRICS_PHASES; p++) {
+        fprintf(f, "forksort_phase_wall_seconds{phase=\"%s\"} %.6f\n", phase_names[p], wall[p]);
+    }
+    metric(f, "forksort_phase_cpu_seconds", "gauge", "seconds", "User and system CPU time of all processes in a phase of the run.");
+    for (int p = 0; p < METRICS_PHASES; p++) {
+        fprintf(f, "forksort_phase_cpu_seconds{phase=\"%s\"} %.6f\n", phase_names[p], cpu[p]);
+    }
+    metric(f, "forksort_peak_rss_bytes", "gauge", "bytes", "Largest resident set size of a process of the run.");
+    fprintf(f, "forksort_peak_rss_bytes %lld\n", (long long) peak * 1024);
+    metric(f, "forksort_processes", "gauge", NULL, "Processes of the run, the root included.");
+    fprintf(f, "forksort_processes %llu\n", (unsigned long long) shared->processes);
+    metric(f, "forksort_spill_bytes", "gauge", "bytes", "Bytes of long lines stored out-of-line.");
+    fprintf(f, "forksort_spill_bytes %lld\n", (long long) spilled);
+    metric(f, "forksort_comparisons", "gauge", NULL, "Line comparisons of all merges.");
+    fprintf(f, "forksort_comparisons %llu\n", (unsigned long long) shared->comparisons);
+    metric(f, "forksort_throughput_bytes_per_second", "gauge", "bytes_per_second", "Input bytes per second of wall time.");
+    fprintf(f, "forksort_throughput_bytes_per_second %.3f\n", total > 0 ? bytes / total : 0.0);
+    metric(f, "forksort_throughput_records_per_second", "gauge", NULL, "Input lines per second of wall time.");
+    fprintf(f, "forksort_throughput_records_per_second %.3f\n", total > 0 ? records / total : 0.0);
+    metric(f, "forksort_last_run_timestamp_seconds", "gauge", "seconds", "Time the run finished.");
+    fprintf(f, "forksort_last_run_timestamp_seconds %lld\n", (long long) time(NULL));
+    fprintf(f, "# EOF\n");
+
+    if (fflush(f) == EOF || fsync(fd) == -1 || fclose(f) == EOF) {
+        metrics_error(tmp_path);
+    }
+    if (rename(tmp_path, path) == -1) {
+        unlink(tmp_path);
+        metrics_error(path);
+    }
+    free(tmp_path);
+}
@@ -0,0 +1,36 @@
+/**
+ * @file metrics.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Run summary in the OpenMetrics text format (--metrics-file).
+ *
+ * The counters of the whole tree (processes, comparisons) live in a shared page every node adds to when it exits.
+ * The root measures its phases and writes the summary atomically (temporary file and rename), so a collector
+ * such as the node-exporter textfile collector never reads a partial file.
+ **/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/** The phases of a run the root measures. */
+enum metrics_phase {
+    METRICS_READ,
+    METRICS_SORT,
+    METRICS_FINISH,
+    METRICS_PHASES
+};
+
+int metrics_create(void);
+void metrics_attach(int fd);
+bool metrics_enabled(void);
+void metrics_node(uint64_t comparisons);
+
+void metrics_begin(enum metrics_phase phase);
+void metrics_write(const char *path, uint64_t bytes, uint64_t records, off_t spilled);
+
+#endif
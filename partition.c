@@ -0,0 +1,143 @@
+/**
+ * @file partition.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Range partitioning of the input lines by sampled splitters.
+ *
+ * Every line ends with a newline and lines are ordered by longrec_cmp(), exactly like the merge orders them.
+ * The output size of every bucket is known after partitioning, which gives every bucket its offset in the output.
+ *
+ * Equal lines are told apart by their input position, so the lines of a key that dominates the input are spread over
+ * several buckets like distinct keys and every bucket gets its share of the input. A bucket whose lower and upper
+ * splitter hold the same line (a heavy hitter of the sample) contains only copies of that line and is marked uniform,
+ * it needs no sorting.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "partition.h"
+#include "longrec.h"
+
+/** Defines the number of sampled lines per bucket. */
+#define OVERSAMPLE 1024
+
+/** A sampled line and its input position. */
+struct sample {
+    char *line;
+    int pos;
+};
+
+static void *xmalloc(size_t size) {
+    void *p = malloc(size > 0 ? size : 1);
+    if (p == NULL) {
+        fprintf(stderr, "partition: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static int cmp_sample(const void *a, const void *b) {
+    const struct sample *sa = a, *sb = b;
+    int c = longrec_cmp(sa->line, sb->line);
+    if (c != 0) {
+        return c;
+    }
+    return (sa->pos > sb->pos) - (sa->pos < sb->pos);
+}
+
+/**
+ * Classify function
+ * @brief This function returns the bucket of a line, the number of splitters that are not greater than the line.
+ * @details Lines equal to a splitter are ordered by their input position.
+ */
+static size_t classify(const struct sample *splitters, size_t count, const char *line, int pos) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int c = longrec_cmp(splitters[mid].line, line);
+        if (c < 0 || (c == 0 && splitters[mid].pos <= pos)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * Partition lines function
+ * @brief This function splits the lines into buckets of consecutive key ranges of about equal size.
+ * @details The splitters are equidistant elements of a sorted, evenly spaced sample of (line, position) pairs.
+ * The lines keep their input order inside a bucket.
+ * @param lines The lines, each ending with a newline
+ * @param numlines The number of lines
+ * @param buckets The number of buckets
+ * @param size The function that returns the printed size of a line
+ * @param part The partition that is filled
+ */
+void partition_lines(char **lines, int numlines, size_t buckets, size_t (*size)(const char *line), struct partition *part) {
+    size_t samples = buckets * OVERSAMPLE;
+    if (samples > (size_t) numlines) {
+        samples = numlines;
+    }
+    struct sample *sample = xmalloc(samples * sizeof(*sample));
+    for (size_t i = 0; i < samples; i++) {
+        sample[i].pos = (int) (i * (size_t) numlines / samples);
+        sample[i].line = lines[sample[i].pos];
+    }
+    qsort(sample, samples, sizeof(*sample), cmp_sample);
+    struct sample *splitters = xmalloc(buckets * sizeof(*splitters));
+    for (size_t b = 1; b < buckets; b++) {
+        splitters[b - 1] = sample[b * samples / buckets];
+    }
+
+    part->buckets = buckets;
+    part->counts = calloc(buckets, sizeof(*part->counts));
+    part->sizes = calloc(buckets, sizeof(*part->sizes));
+    part->uniform = calloc(buckets, sizeof(*part->uniform));
+    part->lines = xmalloc(buckets * sizeof(*part->lines));
+    uint32_t *ids = xmalloc(numlines * sizeof(*ids));
+    if (part->counts == NULL || part->sizes == NULL || part->uniform == NULL) {
+        fprintf(stderr, "partition: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < numlines; i++) {
+        ids[i] = classify(splitters, buckets - 1, lines[i], i);
+        part->counts[ids[i]] += 1;
+        part->sizes[ids[i]] += size(lines[i]);
+    }
+    for (size_t b = 0; b < buckets; b++) {
+        part->lines[b] = xmalloc(part->counts[b] * sizeof(**part->lines));
+        part->counts[b] = 0;
+    }
+    for (int i = 0; i < numlines; i++) {
+        part->lines[ids[i]][part->counts[ids[i]]++] = lines[i];
+    }
+    for (size_t b = 1; b + 1 < buckets; b++) {
+        part->uniform[b] = longrec_cmp(splitters[b - 1].line, splitters[b].line) == 0;
+    }
+
+    free(ids);
+    free(splitters);
+    free(sample);
+}
+
+/**
+ * Partition free function
+ * @brief This function frees the bucket arrays of a partition (not the lines).
+ * @param part The partition
+ */
+void partition_free(struct partition *part) {
+    for (size_t b = 0; b < part->buckets; b++) {
+        free(part->lines[b]);
+    }
+    free(part->lines);
+    free(part->counts);
+    free(part->sizes);
+    free(part->uniform);
+}
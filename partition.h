@@ -0,0 +1,28 @@
+/**
+ * @file partition.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Range partitioning of the input lines by sampled splitters.
+ **/
+
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/** The lines split into key ranges, bucket i holds only lines not greater than those of bucket i + 1. */
+struct partition {
+    size_t buckets;
+    char ***lines;
+    int *counts;
+    off_t *sizes;
+    bool *uniform;
+};
+
+void partition_lines(char **lines, int numlines, size_t buckets, size_t (*size)(const char *line), struct partition *part);
+void partition_free(struct partition *part);
+
+#endif
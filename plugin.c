@@ -0,0 +1,118 @@
+/**
+ * @file plugin.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Key extraction modules loaded with dlopen() (--plugin=LIB.so).
+ *
+ * The root passes its records to the plugin in batches right after reading them and replaces every record by its
+ * composite line (see compkey.h). The tree then sorts with the built-in byte compare, the plugin is not called per
+ * comparison. Multi-line records are passed as their text, not in the escaped form the tree sorts.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include "plugin.h"
+#include "compkey.h"
+#include "record.h"
+
+static forksort_extract_keys_fn *extract_keys = NULL;
+static size_t stride = PLUGIN_DEFAULT_STRIDE;
+
+static void plugin_error(const char *msg, const char *detail) {
+    fprintf(stderr, "plugin: %s: %s\n", msg, detail);
+    exit(EXIT_FAILURE);
+}
+
+static void *plugin_alloc(void *p, size_t size) {
+    p = realloc(p, size > 0 ? size : 1);
+    if (p == NULL) {
+        plugin_error("Unable to allocate memory", "out of memory");
+    }
+    return p;
+}
+
+/**
+ * Plugin load function
+ * @brief This function loads a plugin and exits if it does not export forksort_extract_keys().
+ * @param path The shared object, a path or a name the dynamic linker searches for
+ */
+void plugin_load(const char *path) {
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        plugin_error("could not load", dlerror());
+    }
+    // ISO C does not convert an object pointer to a function pointer, so dlsym() results are assigned through one
+    *(void **) (&extract_keys) = dlsym(handle, "forksort_extract_keys");
+    if (extract_keys == NULL) {
+        plugin_error(path, "does not export forksort_extract_keys");
+    }
+    forksort_key_stride_fn *key_stride;
+    *(void **) (&key_stride) = dlsym(handle, "forksort_key_stride");
+    if (key_stride != NULL && (stride = key_stride()) == 0) {
+        plugin_error(path, "forksort_key_stride() returned 0");
+    }
+    compkey_enable();
+}
+
+/**
+ * Plugin keys function
+ * @brief This function replaces every line by the composite line of its key and record.
+ * @param lines The lines, each ending with a newline
+ * @param numlines The number of lines
+ */
+void plugin_keys(char **lines, int numlines) {
+    const char **records = plugin_alloc(NULL, PLUGIN_BATCH * sizeof(*records));
+    size_t *lengths = plugin_alloc(NULL, PLUGIN_BATCH * sizeof(*lengths));
+    size_t *key_lengths = plugin_alloc(NULL, PLUGIN_BATCH * sizeof(*key_lengths));
+    size_t *offsets = plugin_alloc(NULL, PLUGIN_BATCH * sizeof(*offsets));
+    unsigned char *keys = plugin_alloc(NULL, PLUGIN_BATCH * stride);
+    char *texts = NULL;
+    size_t texts_size = 0;
+
+    for (int first = 0; first < numlines; first += PLUGIN_BATCH) {
+        size_t count = numlines - first < PLUGIN_BATCH ? numlines - first : PLUGIN_BATCH;
+        size_t used = 0;
+        for (size_t i = 0; i < count; i++) {
+            const char *line = lines[first + i];
+            lengths[i] = strlen(line) - 1;
+            records[i] = line;
+            if (record_active()) {
+                // the texts are collected first, since the arena moves while it grows
+                records[i] = record_text(line, lengths[i], &lengths[i]);
+                if (used + lengths[i] > texts_size) {
+                    texts_size = 2 * (used + lengths[i]);
+                    texts = plugin_alloc(texts, texts_size);
+                }
+                memcpy(texts + used, records[i], lengths[i]);
+                offsets[i] = used;
+                used += lengths[i];
+            }
+        }
+        for (size_t i = 0; record_active() && i < count; i++) {
+            records[i] = texts + offsets[i];
+        }
+
+        if (extract_keys(count, records, lengths, keys, stride, key_lengths) != 0) {
+            plugin_error("forksort_extract_keys() failed", "nonzero return");
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (key_lengths[i] > stride) {
+                plugin_error("forksort_extract_keys() failed", "key longer than the stride");
+            }
+            char *line = lines[first + i];
+            lines[first + i] = compkey_line(keys + i * stride, key_lengths[i], line, strlen(line) - 1);
+            free(line);
+        }
+    }
+
+    free(texts);
+    free(keys);
+    free(offsets);
+    free(key_lengths);
+    free(lengths);
+    free(records);
+}
@@ -0,0 +1,43 @@
+/**
+ * @file plugin.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Key extraction modules loaded with dlopen() (--plugin=LIB.so).
+ *
+ * A plugin exports
+ *
+ *     int forksort_extract_keys(size_t count, const char *const records[], const size_t lengths[],
+ *                               unsigned char *keys, size_t stride, size_t key_lengths[]);
+ *
+ * which derives a binary key for each of count records (without their newline) and stores key i at keys + i * stride,
+ * at most stride bytes, and its length in key_lengths[i]. It returns 0 on success. The records are sorted by their keys
+ * compared with memcmp(), records with equal keys by their bytes. The plugin is called once per batch of up to
+ * PLUGIN_BATCH records, before the tree is forked, and never during the sort.
+ *
+ * A plugin may also export
+ *
+ *     size_t forksort_key_stride(void);
+ *
+ * to ask for more room per key than PLUGIN_DEFAULT_STRIDE bytes.
+ **/
+
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include <stddef.h>
+
+/** Defines the number of records passed to the plugin per call. */
+#define PLUGIN_BATCH 4096
+
+/** Defines the room per key unless the plugin asks for more. */
+#define PLUGIN_DEFAULT_STRIDE 256
+
+typedef int forksort_extract_keys_fn(size_t count, const char *const records[], const size_t lengths[],
+                                     unsigned char *keys, size_t stride, size_t key_lengths[]);
+typedef size_t forksort_key_stride_fn(void);
+
+void plugin_load(const char *path);
+void plugin_keys(char **lines, int numlines);
+
+#endif
@@ -0,0 +1,207 @@
+/**
+ * @file record.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Multi-line records (--paragraph, --record-start=REGEX).
+ *
+ * In paragraph mode a record is a run of non-empty lines, one or more empty lines separate the records and every
+ * record is printed followed by an empty line. With a start pattern every line whose start matches the pattern begins
+ * a new record, the lines up to the next such line belong to it, and lines before the first match form a record too.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "record.h"
+#include "dfa.h"
+
+/** The modes of the record reader. */
+enum record_mode {
+    RECORD_LINES,
+    RECORD_PARAGRAPH,
+    RECORD_START
+};
+
+static enum record_mode mode = RECORD_LINES;
+static struct dfa *start_dfa = NULL;
+static char *description = NULL;
+
+/** The line read ahead in start mode: the start of the next record, -1 if there is none. */
+static char *line = NULL;
+static size_t line_size = 0;
+static ssize_t pending = -1;
+
+static void record_error(const char *msg) {
+    fprintf(stderr, "record: %s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+void record_paragraph_mode(void) {
+    mode = RECORD_PARAGRAPH;
+    description = "paragraph";
+}
+
+/**
+ * Record start mode function
+ * @brief This function compiles the pattern that matches the first line of a record and exits if it is invalid.
+ * @param pattern The pattern
+ */
+void record_start_mode(const char *pattern) {
+    const char *error;
+    if ((start_dfa = dfa_compile(pattern, &error)) == NULL) {
+        fprintf(stderr, "record: invalid pattern '%s': %s\n", pattern, error);
+        exit(EXIT_FAILURE);
+    }
+    mode = RECORD_START;
+    description = malloc(strlen(pattern) + sizeof("start:"));
+    if (description == NULL) {
+        record_error("Unable to allocate memory");
+    }
+    strcpy(description, "start:");
+    strcat(description, pattern);
+}
+
+bool record_active(void) {
+    return mode != RECORD_LINES;
+}
+
+/**
+ * Record describe function
+ * @return The mode and pattern, part of the cache key since they change the output
+ */
+const char *record_describe(void) {
+    return description != NULL ? description : "lines";
+}
+
+static void reserve(char **lineptr, size_t *n, size_t size) {
+    if (*lineptr == NULL || *n < size) {
+        size_t grown = *n > 0 ? *n : 128;
+        while (grown < size) {
+            grown *= 2;
+        }
+        char *p = realloc(*lineptr, grown);
+        if (p == NULL) {
+            record_error("Unable to reallocate memory for record");
+        }
+        *lineptr = p;
+        *n = grown;
+    }
+}
+
+/**
+ * Append function
+ * @brief This function appends the escape of bytes to the record at len.
+ * @return The new length of the record
+ */
+static size_t append(char **lineptr, size_t *n, size_t len, const char *bytes, size_t count) {
+    reserve(lineptr, n, len + 2 * count + 2);
+    char *dst = *lineptr + len;
+    for (size_t i = 0; i < count; i++) {
+        if (bytes[i] == '\n' || bytes[i] == RECORD_ESCAPE) {
+            *dst++ = RECORD_ESCAPE;
+            *dst++ = bytes[i] == '\n' ? '\x01' : '\x02';
+        } else {
+            *dst++ = bytes[i];
+        }
+    }
+    return dst - *lineptr;
+}
+
+/**
+ * Record read function
+ * @brief This function reads the next record like getline(): joined, escaped and ending with a newline.
+ * @param stream The input
+ * @param lineptr The buffer of the record, grown as needed
+ * @param n The size of the buffer
+ * @return The length of the record or -1 at the end of the input
+ */
+ssize_t record_read(FILE *stream, char **lineptr, size_t *n) {
+    size_t len = 0;
+    bool any = false;
+    for (;;) {
+        ssize_t read = pending;
+        pending = -1;
+        if (read == -1 && (read = getline(&line, &line_size, stream)) == -1) {
+            break;
+        }
+        if (read > 0 && line[read - 1] == '\n') {
+            read -= 1;
+        }
+        if (mode == RECORD_PARAGRAPH && read == 0) {
+            if (any) {
+                break;
+            }
+            continue;
+        }
+        if (mode == RECORD_START && any && dfa_match_prefix(start_dfa, line, read)) {
+            pending = read;
+            break;
+        }
+        if (any) {
+            len = append(lineptr, n, len, "\n", 1);
+        }
+        len = append(lineptr, n, len, line, read);
+        any = true;
+    }
+    if (!any) {
+        free(line);
+        line = NULL;
+        line_size = 0;
+        return -1;
+    }
+    reserve(lineptr, n, len + 2);
+    (*lineptr)[len++] = '\n';
+    (*lineptr)[len] = '\0';
+    return len;
+}
+
+/**
+ * Unescape function
+ * @brief This function restores the text of a record into a static buffer, leaving room for one more byte.
+ */
+static char *unescape(const char *body, size_t len, size_t *out_len) {
+    static char *buf = NULL;
+    static size_t size = 0;
+    reserve(&buf, &size, len + 1);
+    char *dst = buf;
+    for (size_t i = 0; i < len; i++) {
+        if (body[i] == RECORD_ESCAPE && i + 1 < len) {
+            i += 1;
+            *dst++ = body[i] == '\x01' ? '\n' : RECORD_ESCAPE;
+        } else {
+            *dst++ = body[i];
+        }
+    }
+    *out_len = dst - buf;
+    return buf;
+}
+
+/**
+ * Record text function
+ * @brief This function restores the text of a record.
+ * @param body The escaped record without its newline
+ * @param len The length of the escaped record
+ * @param out_len Set to the length of the text
+ * @return The text in a static buffer that is valid until the next call of this function or record_unescape()
+ */
+const char *record_text(const char *body, size_t len, size_t *out_len) {
+    return unescape(body, len, out_len);
+}
+
+/**
+ * Record unescape function
+ * @brief This function restores the text of a record as it is printed: in paragraph mode followed by the newline of its
+ * last line.
+ * @param body The escaped record without its newline
+ * @param len The length of the escaped record
+ * @param out_len Set to the length of the text
+ * @return The text in a static buffer that is valid until the next call of this function or record_text()
+ */
+const char *record_unescape(const char *body, size_t len, size_t *out_len) {
+    char *buf = unescape(body, len, out_len);
+    if (mode == RECORD_PARAGRAPH) {
+        buf[(*out_len)++] = '\n';
+    }
+    return buf;
+}
@@ -0,0 +1,34 @@
+/**
+ * @file record.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Multi-line records (--paragraph, --record-start=REGEX).
+ *
+ * The root joins the lines of a record into one line the tree sorts like any other: the newlines inside the record
+ * are escaped as 0x0b 0x01 and the byte 0x0b as 0x0b 0x02. The escape keeps the order of the records, since the
+ * escape of a newline sorts exactly where the newline did among the other bytes and the end of the record.
+ * The root unescapes a record when it prints it.
+ **/
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/** Defines the escape byte of the joined records. */
+#define RECORD_ESCAPE '\x0b'
+
+void record_paragraph_mode(void);
+void record_start_mode(const char *pattern);
+bool record_active(void);
+const char *record_describe(void);
+
+ssize_t record_read(FILE *stream, char **lineptr, size_t *n);
+const char *record_text(const char *body, size_t len, size_t *out_len);
+const char *record_unescape(const char *body, size_t len, size_t *out_len);
+
+#endif
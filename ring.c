@@ -0,0 +1,281 @@
+/**
+ * @file ring.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Single-producer/single-consumer ring of lines in shared memory.
+ *
+ * A ring is a memfd that holds a header page and a power of two sized data area. The producer only writes head,
+ * the consumer only writes tail, both are free running byte counters. A record is a 32 bit length, 4 unused bytes
+ * and the line with its NUL, padded to 8 bytes, so the consumer can use it as a string where it lies. A record never
+ * wraps around the end of the data area, the producer writes a wrap marker and continues at the start instead.
+ *
+ * A side that finds the ring empty or full announces that it waits and sleeps on a futex sequence word, the other
+ * side only issues a wake-up system call if it sees the announcement. The waits time out regularly to notice
+ * a peer that died without closing the ring.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/futex.h>
+
+#include "ring.h"
+
+/** Defines the size of the header page. */
+#define HEADER_SIZE 4096
+
+/** Defines the smallest ring. */
+#define RING_MIN_SIZE 4096
+
+/** Defines the length of a wrap marker. */
+#define WRAP UINT32_MAX
+
+/** Defines the interval in which a waiting side checks its peer (100 ms). */
+#define WAIT_NS 100000000L
+
+/** The shared header, head and tail live on separate cache lines. */
+struct ring_header {
+    uint64_t head;
+    char pad1[56];
+    uint64_t tail;
+    char pad2[56];
+    uint32_t data_seq;
+    uint32_t space_seq;
+    uint32_t consumer_waiting;
+    uint32_t producer_waiting;
+    uint32_t closed;
+};
+
+static void ring_error(const char *msg) {
+    fprintf(stderr, "ring: %s: %s\n", msg, strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+static size_t record_size(size_t len) {
+    return (8 + len + 1 + 7) & ~(size_t) 7;
+}
+
+/**
+ * Futex wait function
+ * @brief This function sleeps until the sequence word changes from seen, a wake-up or the timeout.
+ * @return true if the wait timed out
+ */
+static bool futex_wait(uint32_t *word, uint32_t seen) {
+    struct timespec timeout = { .tv_sec = 0, .tv_nsec = WAIT_NS };
+    return syscall(SYS_futex, word, FUTEX_WAIT, seen, &timeout, NULL, 0) == -1 && errno == ETIMEDOUT;
+}
+
+static void futex_wake(uint32_t *word) {
+    __atomic_add_fetch(word, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/**
+ * Peer alive function
+ * @brief This function checks whether the process on the other end of the ring is still running.
+ * @details The peer is either the parent of this process or a child that is not reaped before the ring is done.
+ */
+static bool peer_alive(const struct ring *ring) {
+    if (ring->peer == getppid()) {
+        return true;
+    }
+    siginfo_t info;
+    info.si_pid = 0;
+    if (waitid(P_PID, ring->peer, &info, WEXITED | WNOHANG | WNOWAIT) == -1) {
+        return false;
+    }
+    return info.si_pid == 0;
+}
+
+/**
+ * Ring size function
+ * @brief This function returns the size of a ring for a number of lines, enough for all of them up to RING_MAX_SIZE.
+ * @param bytes The total length of the lines
+ * @param lines The number of lines
+ * @return The size of the data area, a power of two
+ */
+size_t ring_size(size_t bytes, size_t lines) {
+    // twice the data, so any of the lines fits behind a wrap marker
+    size_t need = 2 * (bytes + 16 * lines);
+    size_t size = RING_MIN_SIZE;
+    while (size < need && size < RING_MAX_SIZE) {
+        size *= 2;
+    }
+    return size;
+}
+
+/**
+ * Ring create function
+ * @brief This function creates the shared memory of a ring.
+ * @param size The size of the data area (see ring_size())
+ * @return The file descriptor of the ring (close-on-exec)
+ */
+int ring_create(size_t size) {
+    int fd = memfd_create("forksort-ring", MFD_CLOEXEC);
+    if (fd == -1) {
+        ring_error("could not create ring");
+    }
+    if (ftruncate(fd, HEADER_SIZE + size) == -1) {
+        ring_error("could not size ring");
+    }
+    return fd;
+}
+
+/**
+ * Ring map function
+ * @brief This function maps one end of a ring.
+ * @param ring The ring end
+ * @param fd The file descriptor of the ring, it can be closed afterwards
+ * @param peer The process on the other end
+ */
+void ring_map(struct ring *ring, int fd, pid_t peer) {
+    off_t total = lseek(fd, 0, SEEK_END);
+    if (total <= HEADER_SIZE) {
+        ring_error("not a ring");
+    }
+    char *base = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ring_error("could not map ring");
+    }
+    ring->hdr = (struct ring_header *) base;
+    ring->data = base + HEADER_SIZE;
+    ring->size = total - HEADER_SIZE;
+    ring->pos = 0;
+    ring->held = 0;
+    ring->peer = peer;
+}
+
+void ring_unmap(struct ring *ring) {
+    munmap(ring->hdr, HEADER_SIZE + ring->size);
+    ring->hdr = NULL;
+}
+
+/**
+ * Ring put function
+ * @brief This function copies a line into the ring and waits while the ring is full.
+ * @param ring The producer end
+ * @param line The line
+ * @param len The length of the line (without its NUL), at most half of the ring
+ */
+void ring_put(struct ring *ring, const char *line, size_t len) {
+    struct ring_header *hdr = ring->hdr;
+    size_t need = record_size(len);
+    size_t to_end = ring->size - (ring->pos & (ring->size - 1));
+    size_t total = need <= to_end ? need : to_end + need;
+    if (total > ring->size) {
+        errno = EMSGSIZE;
+        ring_error("line does not fit into ring");
+    }
+
+    while (ring->size - (ring->pos - __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE)) < total) {
+        uint32_t seen = __atomic_load_n(&hdr->space_seq, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&hdr->producer_waiting, 1, __ATOMIC_SEQ_CST);
+        if (ring->size - (ring->pos - __atomic_load_n(&hdr->tail, __ATOMIC_SEQ_CST)) < total) {
+            if (futex_wait(&hdr->space_seq, seen) && !peer_alive(ring)) {
+                errno = EPIPE;
+                ring_error("consumer exited");
+            }
+        }
+        __atomic_store_n(&hdr->producer_waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    if (need > to_end) {
+        uint32_t wrap = WRAP;
+        memcpy(ring->data + (ring->pos & (ring->size - 1)), &wrap, sizeof(wrap));
+        ring->pos += to_end;
+    }
+    char *rec = ring->data + (ring->pos & (ring->size - 1));
+    uint32_t len32 = (uint32_t) len;
+    memcpy(rec, &len32, sizeof(len32));
+    memcpy(rec + 8, line, len);
+    rec[8 + len] = '\0';
+    ring->pos += need;
+
+    __atomic_store_n(&hdr->head, ring->pos, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&hdr->consumer_waiting, __ATOMIC_SEQ_CST)) {
+        futex_wake(&hdr->data_seq);
+    }
+}
+
+/**
+ * Ring close function
+ * @brief This function marks the end of the lines and unmaps the producer end.
+ * @param ring The producer end
+ */
+void ring_close(struct ring *ring) {
+    __atomic_store_n(&ring->hdr->closed, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->hdr->consumer_waiting, __ATOMIC_SEQ_CST)) {
+        futex_wake(&ring->hdr->data_seq);
+    }
+    ring_unmap(ring);
+}
+
+/**
+ * Release function
+ * @brief This function hands the bytes up to the read position back to the producer.
+ */
+static void release(struct ring *ring) {
+    __atomic_store_n(&ring->hdr->tail, ring->pos, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->hdr->producer_waiting, __ATOMIC_SEQ_CST)) {
+        futex_wake(&ring->hdr->space_seq);
+    }
+}
+
+/**
+ * Ring get function
+ * @brief This function releases the previous line and returns the next one in place, it waits while the ring is empty.
+ * @param ring The consumer end
+ * @param len The length of the line (without its NUL)
+ * @return The line, valid until the next call, or NULL after the last line
+ */
+char *ring_get(struct ring *ring, size_t *len) {
+    struct ring_header *hdr = ring->hdr;
+    if (ring->held > 0) {
+        ring->pos += ring->held;
+        ring->held = 0;
+        release(ring);
+    }
+
+    for (;;) {
+        if (__atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE) != ring->pos) {
+            char *rec = ring->data + (ring->pos & (ring->size - 1));
+            uint32_t len32;
+            memcpy(&len32, rec, sizeof(len32));
+            if (len32 == WRAP) {
+                ring->pos += ring->size - (ring->pos & (ring->size - 1));
+                release(ring);
+                continue;
+            }
+            ring->held = record_size(len32);
+            *len = len32;
+            return rec + 8;
+        }
+        if (__atomic_load_n(&hdr->closed, __ATOMIC_SEQ_CST)) {
+            if (__atomic_load_n(&hdr->head, __ATOMIC_SEQ_CST) == ring->pos) {
+                return NULL;
+            }
+            continue;
+        }
+
+        uint32_t seen = __atomic_load_n(&hdr->data_seq, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&hdr->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&hdr->head, __ATOMIC_SEQ_CST) == ring->pos
+                && !__atomic_load_n(&hdr->closed, __ATOMIC_SEQ_CST)) {
+            if (futex_wait(&hdr->data_seq, seen) && !peer_alive(ring)
+                    && !__atomic_load_n(&hdr->closed, __ATOMIC_SEQ_CST)) {
+                errno = EPIPE;
+                ring_error("producer exited");
+            }
+        }
+        __atomic_store_n(&hdr->consumer_waiting, 0, __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,47 @@
+/**
+ * @file ring.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Single-producer/single-consumer ring of lines in shared memory.
+ *
+ * A ring connects a parent of the tree with one of its children in place of a pipe. The producer copies every line
+ * into the ring once, the consumer reads it in place and releases it when it fetches the next one. A side only
+ * sleeps on a futex if the ring is empty (consumer) or full (producer).
+ **/
+
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/** Defines the largest ring (1 MiB of lines), lines up to half of it can be passed through a ring. */
+#define RING_MAX_SIZE ((size_t) 1 << 20)
+
+/** Defines the amount of lines (64 KiB, a pipe buffer) below which pipes are cheaper than rings. */
+#define RING_MIN_DATA ((size_t) 64 << 10)
+
+struct ring_header;
+
+/** One end of a mapped ring. */
+struct ring {
+    struct ring_header *hdr;
+    char *data;
+    size_t size;
+    uint64_t pos;
+    size_t held;
+    pid_t peer;
+};
+
+size_t ring_size(size_t bytes, size_t lines);
+int ring_create(size_t size);
+void ring_map(struct ring *ring, int fd, pid_t peer);
+void ring_unmap(struct ring *ring);
+
+void ring_put(struct ring *ring, const char *line, size_t len);
+void ring_close(struct ring *ring);
+char *ring_get(struct ring *ring, size_t *len);
+
+#endif
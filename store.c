@@ -0,0 +1,635 @@
+/**
+ * @file store.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Persistent sorted store made of immutable sorted runs (log-structured merge).
+ *
+ * A batch is sorted by the usual process tree into a temporary file which becomes a level 0 run.
+ * After every add a detached process compacts the store: it picks runs according to the policy,
+ * merges them into a new run without holding the manifest lock and swaps the runs in the manifest.
+ * Readers map the runs listed in the manifest, so a compaction never disturbs a running "store cat".
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "store.h"
+#include "line.h"
+#include "dio.h"
+
+/** Defines the number of runs that are merged into one run of the next level. */
+#define STORE_FANOUT 4
+
+/** Defines the size of the level 1 run of the leveled policy, every level is STORE_FANOUT times larger. */
+#define STORE_LEVEL_BASE ((off_t) 16 << 20)
+
+/** Defines the buffer size of "store cat". */
+#define STORE_BUFFER (256 * 1024)
+
+#define MANIFEST_HEADER "forksort-store 1"
+
+/** A live run as listed in the manifest. */
+struct run_ref {
+    unsigned level;
+    unsigned long long seq;
+};
+
+/** The manifest of a store. */
+struct manifest {
+    enum store_policy policy;
+    unsigned long long next;
+    struct run_ref *runs;
+    size_t count;
+    size_t cap;
+};
+
+/** A mapped run that is merged. */
+struct cursor {
+    char *map;
+    size_t size;
+    const char *p;
+    const char *line;
+    size_t len;
+};
+
+/**
+ * Store error function
+ * @brief This function writes a store error to stderr and exits with an EXIT_FAILURE status
+ * @param msg The message
+ */
+static void store_error(const char *msg) {
+    fprintf(stderr, "store: %s: %s\n", msg, strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+static char *store_path(const char *dir, const char *name) {
+    size_t len = strlen(dir) + strlen(name) + 2;
+    char *path = malloc(len);
+    if (path == NULL) {
+        store_error("out of memory");
+    }
+    snprintf(path, len, "%s/%s", dir, name);
+    return path;
+}
+
+static char *run_path(const char *dir, unsigned long long seq) {
+    char name[32];
+    snprintf(name, sizeof(name), "run-%06llu", seq);
+    return store_path(dir, name);
+}
+
+/**
+ * Lock function
+ * @brief This function opens (creates) a lock file of the store and locks it.
+ * @param dir The store directory
+ * @param name The name of the lock file
+ * @param op The flock() operation
+ * @return The locked file descriptor or -1 if a non-blocking lock is held by someone else
+ */
+static int lock_file(const char *dir, const char *name, int op) {
+    char *path = store_path(dir, name);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    free(path);
+    if (fd == -1) {
+        store_error("could not open lock file");
+    }
+    while (flock(fd, op) == -1) {
+        if (errno == EWOULDBLOCK) {
+            close(fd);
+            return -1;
+        }
+        if (errno != EINTR) {
+            store_error("could not lock store");
+        }
+    }
+    return fd;
+}
+
+static void unlock_file(int fd) {
+    close(fd);
+}
+
+static void manifest_add(struct manifest *m, unsigned level, unsigned long long seq) {
+    if (m->count == m->cap) {
+        m->cap = m->cap ? m->cap * 2 : 16;
+        struct run_ref *grown = realloc(m->runs, m->cap * sizeof(*grown));
+        if (grown == NULL) {
+            store_error("out of memory");
+        }
+        m->runs = grown;
+    }
+    m->runs[m->count].level = level;
+    m->runs[m->count].seq = seq;
+    m->count += 1;
+}
+
+static void manifest_remove(struct manifest *m, unsigned long long seq) {
+    for (size_t i = 0; i < m->count; i++) {
+        if (m->runs[i].seq == seq) {
+            memmove(&m->runs[i], &m->runs[i + 1], (m->count - i - 1) * sizeof(*m->runs));
+            m->count -= 1;
+            return;
+        }
+    }
+}
+
+/**
+ * Manifest read function
+ * @brief This function reads the manifest of a store, a missing manifest is an empty store.
+ * @param dir The store directory
+ * @param m The manifest that is filled
+ * @param policy The policy of an empty store
+ */
+static void manifest_read(const char *dir, struct manifest *m, enum store_policy policy) {
+    m->policy = policy;
+    m->next = 1;
+    m->runs = NULL;
+    m->count = m->cap = 0;
+
+    char *path = store_path(dir, "MANIFEST");
+    FILE *f = fopen(path, "re");
+    free(path);
+    if (f == NULL) {
+        if (errno == ENOENT) {
+            return;
+        }
+        store_error("could not open manifest");
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    bool valid = getline(&line, &cap, f) != -1 && strncmp(line, MANIFEST_HEADER, strlen(MANIFEST_HEADER)) == 0;
+    while (valid && getline(&line, &cap, f) != -1) {
+        char word[16];
+        unsigned level;
+        unsigned long long seq;
+        if (sscanf(line, "policy %15s", word) == 1) {
+            valid = store_parse_policy(word, &m->policy);
+        } else if (sscanf(line, "next %llu", &seq) == 1) {
+            m->next = seq;
+        } else if (sscanf(line, "run %u %llu", &level, &seq) == 2) {
+            manifest_add(m, level, seq);
+        } else {
+            valid = false;
+        }
+    }
+    free(line);
+    fclose(f);
+    if (!valid) {
+        fprintf(stderr, "store: %s has a corrupt manifest\n", dir);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Manifest write function
+ * @brief This function replaces the manifest of a store atomically.
+ * @param dir The store directory
+ * @param m The manifest
+ */
+static void manifest_write(const char *dir, const struct manifest *m) {
+    char *tmp = store_path(dir, "MANIFEST.tmp");
+    char *path = store_path(dir, "MANIFEST");
+    FILE *f = fopen(tmp, "we");
+    if (f == NULL) {
+        store_error("could not write manifest");
+    }
+    fprintf(f, "%s\npolicy %s\nnext %llu\n", MANIFEST_HEADER, m->policy == STORE_LEVELED ? "leveled" : "tiered", m->next);
+    for (size_t i = 0; i < m->count; i++) {
+        fprintf(f, "run %u %llu\n", m->runs[i].level, m->runs[i].seq);
+    }
+    if (fflush(f) == EOF || fsync(fileno(f)) == -1 || fclose(f) == EOF) {
+        store_error("could not write manifest");
+    }
+    if (rename(tmp, path) == -1) {
+        store_error("could not replace manifest");
+    }
+    free(tmp);
+    free(path);
+}
+
+static void cursor_next(struct cursor *c) {
+    const char *end = c->map + c->size;
+    if (c->p >= end) {
+        c->line = NULL;
+        return;
+    }
+    const char *nl = memchr(c->p, '\n', end - c->p);
+    c->line = c->p;
+    c->len = nl ? (size_t) (nl - c->p) : (size_t) (end - c->p);
+    c->p += c->len + 1;
+}
+
+static void cursor_open(const char *dir, unsigned long long seq, struct cursor *c) {
+    char *path = run_path(dir, seq);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    free(path);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        store_error("could not open run");
+    }
+    c->size = st.st_size;
+    c->map = NULL;
+    if (c->size > 0) {
+        if ((c->map = mmap(NULL, c->size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+            store_error("could not map run");
+        }
+        madvise(c->map, c->size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    c->p = c->map;
+    cursor_next(c);
+}
+
+static void cursor_close(struct cursor *c) {
+    if (c->size > 0) {
+        munmap(c->map, c->size);
+    }
+}
+
+static bool cursor_less(const struct cursor *a, const struct cursor *b) {
+    return cmp_line(a->line, a->len, b->line, b->len) < 0;
+}
+
+static void sift_down(struct cursor **heap, size_t n, size_t i) {
+    for (;;) {
+        size_t min = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && cursor_less(heap[l], heap[min])) {
+            min = l;
+        }
+        if (r < n && cursor_less(heap[r], heap[min])) {
+            min = r;
+        }
+        if (min == i) {
+            return;
+        }
+        struct cursor *tmp = heap[i];
+        heap[i] = heap[min];
+        heap[min] = tmp;
+        i = min;
+    }
+}
+
+/**
+ * Merge runs function
+ * @brief This function merges sorted runs into one sorted stream with a binary heap of the run heads.
+ * @param cursors The opened runs
+ * @param n The number of runs
+ * @param out The stream the merged lines are written to
+ */
+static void merge_runs(struct cursor *cursors, size_t n, FILE *out) {
+    struct cursor **heap = malloc(n * sizeof(*heap));
+    if (heap == NULL && n > 0) {
+        store_error("out of memory");
+    }
+    size_t size = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (cursors[i].line != NULL) {
+            heap[size++] = &cursors[i];
+        }
+    }
+    for (size_t i = size / 2; i-- > 0;) {
+        sift_down(heap, size, i);
+    }
+
+    while (size > 0) {
+        struct cursor *c = heap[0];
+        if (fwrite(c->line, 1, c->len, out) != c->len || putc('\n', out) == EOF) {
+            store_error("could not write merged runs");
+        }
+        cursor_next(c);
+        if (c->line == NULL) {
+            heap[0] = heap[--size];
+        }
+        sift_down(heap, size, 0);
+    }
+    free(heap);
+}
+
+static off_t run_size(const char *dir, unsigned long long seq) {
+    char *path = run_path(dir, seq);
+    struct stat st;
+    off_t size = stat(path, &st) == 0 ? st.st_size : 0;
+    free(path);
+    return size;
+}
+
+static int cmp_run_ref(const void *a, const void *b) {
+    const struct run_ref *x = a;
+    const struct run_ref *y = b;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+/**
+ * Pick function
+ * @brief This function picks the runs of the next compaction according to the policy of the store.
+ * @details Tiered: the STORE_FANOUT oldest runs of the lowest level that has that many runs.
+ * Leveled: all level 0 runs together with the level 1 run once there are STORE_FANOUT of them, otherwise
+ * the run of the lowest level that outgrew its size together with the run of the next level.
+ * @param dir The store directory
+ * @param m The manifest
+ * @param inputs The picked runs (at least STORE_FANOUT + 1 entries)
+ * @param level The level of the merged run
+ * @return The number of picked runs, 0 if the store needs no compaction
+ */
+static size_t pick(const char *dir, const struct manifest *m, struct run_ref *inputs, unsigned *level) {
+    struct run_ref *runs = malloc((m->count + 1) * sizeof(*runs));
+    if (runs == NULL) {
+        store_error("out of memory");
+    }
+    memcpy(runs, m->runs, m->count * sizeof(*runs));
+    qsort(runs, m->count, sizeof(*runs), cmp_run_ref);
+
+    unsigned max_level = 0;
+    size_t per_level[64] = { 0 };
+    for (size_t i = 0; i < m->count; i++) {
+        if (runs[i].level >= 64) {
+            continue;
+        }
+        per_level[runs[i].level] += 1;
+        if (runs[i].level > max_level) {
+            max_level = runs[i].level;
+        }
+    }
+
+    size_t n = 0;
+    if (m->policy == STORE_TIERED) {
+        for (unsigned l = 0; l <= max_level && n == 0; l++) {
+            if (per_level[l] < STORE_FANOUT) {
+                continue;
+            }
+            for (size_t i = 0; i < m->count && n < STORE_FANOUT; i++) {
+                if (runs[i].level == l) {
+                    inputs[n++] = runs[i];
+                }
+            }
+            *level = l + 1;
+        }
+    } else if (per_level[0] >= STORE_FANOUT) {
+        for (size_t i = 0; i < m->count && n < STORE_FANOUT; i++) {
+            if (runs[i].level == 0) {
+                inputs[n++] = runs[i];
+            }
+        }
+        for (size_t i = 0; i < m->count; i++) {
+            if (runs[i].level == 1) {
+                inputs[n++] = runs[i];
+                break;
+            }
+        }
+        *level = 1;
+    } else {
+        off_t limit = STORE_LEVEL_BASE;
+        for (unsigned l = 1; l <= max_level && n == 0; l++, limit *= STORE_FANOUT) {
+            for (size_t i = 0; i < m->count; i++) {
+                if (runs[i].level == l && run_size(dir, runs[i].seq) > limit) {
+                    inputs[n++] = runs[i];
+                    break;
+                }
+            }
+            if (n == 0) {
+                continue;
+            }
+            for (size_t i = 0; i < m->count; i++) {
+                if (runs[i].level == l + 1) {
+                    inputs[n++] = runs[i];
+                    break;
+                }
+            }
+            *level = l + 1;
+        }
+    }
+    free(runs);
+    return n;
+}
+
+/**
+ * Compact function
+ * @brief This function compacts the store until the policy picks no more runs.
+ * @details Only one compaction runs per store, a second one returns immediately.
+ * @param dir The store directory
+ * @param direct true if the merged runs are written with O_DIRECT
+ */
+static void compact(const char *dir, bool direct) {
+    int compact_fd = lock_file(dir, "COMPACT", LOCK_EX | LOCK_NB);
+    if (compact_fd == -1) {
+        return;
+    }
+
+    for (;;) {
+        struct manifest m;
+        struct run_ref inputs[STORE_FANOUT + 1];
+        unsigned level = 0;
+
+        int lock = lock_file(dir, "LOCK", LOCK_EX);
+        manifest_read(dir, &m, STORE_TIERED);
+        size_t n = pick(dir, &m, inputs, &level);
+        unsigned long long seq = m.next;
+        if (n > 0) {
+            m.next += 1;
+            manifest_write(dir, &m);
+        }
+        unlock_file(lock);
+        free(m.runs);
+        if (n == 0) {
+            break;
+        }
+
+        struct cursor cursors[STORE_FANOUT + 1];
+        for (size_t i = 0; i < n; i++) {
+            cursor_open(dir, inputs[i].seq, &cursors[i]);
+        }
+        char *tmp = store_path(dir, ".tmp.XXXXXX");
+        int fd = mkostemp(tmp, O_CLOEXEC);
+        FILE *out;
+        if (fd == -1 || (out = dio_open(fd, 0, direct)) == NULL) {
+            store_error("could not create run");
+        }
+        merge_runs(cursors, n, out);
+        if (fclose(out) == EOF || fsync(fd) == -1 || close(fd) == -1) {
+            store_error("could not write run");
+        }
+        for (size_t i = 0; i < n; i++) {
+            cursor_close(&cursors[i]);
+        }
+
+        lock = lock_file(dir, "LOCK", LOCK_EX);
+        manifest_read(dir, &m, STORE_TIERED);
+        char *path = run_path(dir, seq);
+        if (rename(tmp, path) == -1) {
+            store_error("could not publish run");
+        }
+        free(path);
+        free(tmp);
+        for (size_t i = 0; i < n; i++) {
+            manifest_remove(&m, inputs[i].seq);
+        }
+        manifest_add(&m, level, seq);
+        manifest_write(dir, &m);
+        unlock_file(lock);
+        free(m.runs);
+
+        for (size_t i = 0; i < n; i++) {
+            path = run_path(dir, inputs[i].seq);
+            unlink(path);
+            free(path);
+        }
+    }
+    unlock_file(compact_fd);
+}
+
+/**
+ * Spawn compaction function
+ * @brief This function compacts the store in a detached background process.
+ * @param dir The store directory
+ * @param direct true if the merged runs are written with O_DIRECT
+ */
+static void spawn_compaction(const char *dir, bool direct) {
+    fflush(NULL);
+    switch (fork()) {
+        case -1:
+            fprintf(stderr, "store: could not start compaction: %s\n", strerror(errno));
+            return;
+        case 0: {
+            setsid();
+            int null = open("/dev/null", O_RDWR);
+            if (null != -1) {
+                dup2(null, STDIN_FILENO);
+                dup2(null, STDOUT_FILENO);
+                close(null);
+            }
+            compact(dir, direct);
+            _exit(EXIT_SUCCESS);
+        }
+        default:
+            return;
+    }
+}
+
+/**
+ * Parse policy function
+ * @brief This function parses the name of a compaction policy.
+ * @param arg The name ("tiered" or "leveled")
+ * @param policy The parsed policy
+ * @return false if the name is unknown
+ */
+bool store_parse_policy(const char *arg, enum store_policy *policy) {
+    if (strcmp(arg, "tiered") == 0) {
+        *policy = STORE_TIERED;
+    } else if (strcmp(arg, "leveled") == 0) {
+        *policy = STORE_LEVELED;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Add begin function
+ * @brief This function creates the store directory if needed and the temporary file the sorted batch is written to.
+ * @param st The store
+ * @return The file descriptor of the temporary file
+ */
+int store_add_begin(struct store *st) {
+    if (mkdir(st->dir, 0777) == -1 && errno != EEXIST) {
+        store_error("could not create store");
+    }
+    st->tmp_path = store_path(st->dir, ".tmp.XXXXXX");
+    if ((st->tmp_fd = mkostemp(st->tmp_path, O_CLOEXEC)) == -1) {
+        store_error("could not create run");
+    }
+    return st->tmp_fd;
+}
+
+/**
+ * Add commit function
+ * @brief This function publishes the written batch as a level 0 run and starts a background compaction.
+ * @details The policy of the store is fixed by the first add.
+ * @param st The store
+ */
+void store_add_commit(struct store *st) {
+    if (fsync(st->tmp_fd) == -1 || close(st->tmp_fd) == -1) {
+        store_error("could not write run");
+    }
+
+    struct manifest m;
+    int lock = lock_file(st->dir, "LOCK", LOCK_EX);
+    manifest_read(st->dir, &m, st->policy);
+    unsigned long long seq = m.next++;
+    char *path = run_path(st->dir, seq);
+    if (rename(st->tmp_path, path) == -1) {
+        store_error("could not publish run");
+    }
+    manifest_add(&m, 0, seq);
+    manifest_write(st->dir, &m);
+    unlock_file(lock);
+
+    free(m.runs);
+    free(path);
+    free(st->tmp_path);
+    st->tmp_path = NULL;
+
+    spawn_compaction(st->dir, st->direct);
+}
+
+/**
+ * Cat function
+ * @brief This function merges all runs of a store to stdout.
+ * @details The runs are mapped while the manifest is locked, so a concurrent compaction cannot remove them in between.
+ * @param dir The store directory
+ */
+static void cat(const char *dir) {
+    struct manifest m;
+    int lock = lock_file(dir, "LOCK", LOCK_SH);
+    manifest_read(dir, &m, STORE_TIERED);
+    struct cursor *cursors = malloc((m.count + 1) * sizeof(*cursors));
+    if (cursors == NULL) {
+        store_error("out of memory");
+    }
+    for (size_t i = 0; i < m.count; i++) {
+        cursor_open(dir, m.runs[i].seq, &cursors[i]);
+    }
+    unlock_file(lock);
+
+    setvbuf(stdout, NULL, _IOFBF, STORE_BUFFER);
+    merge_runs(cursors, m.count, stdout);
+    if (fflush(stdout) == EOF) {
+        store_error("could not write output");
+    }
+    for (size_t i = 0; i < m.count; i++) {
+        cursor_close(&cursors[i]);
+    }
+    free(cursors);
+    free(m.runs);
+}
+
+/**
+ * Store main function
+ * @brief This function implements "forksort store cat DIR" and "forksort store compact DIR".
+ * @details "store add" sorts its input with the process tree and is therefore handled by main().
+ * @param argc The argument count, argv[0] is "store"
+ * @param argv The arguments
+ * @return The exit status
+ */
+int store_main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "cat") == 0) {
+        cat(argv[2]);
+    } else if (argc == 3 && strcmp(argv[1], "compact") == 0) {
+        compact(argv[2], false);
+    } else {
+        fprintf(stderr, "USAGE: forksort store add [--policy=tiered|leveled] DIR < batch\n"
+                        "       forksort store cat DIR\n"
+                        "       forksort store compact DIR\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file store.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Persistent sorted store made of immutable sorted runs (log-structured merge).
+ *
+ * "store add" sorts a batch into a new run, "store cat" merges all runs into one sorted stream.
+ * Runs are merged in the background, either tiered (FANOUT runs of a level become one run of the next level)
+ * or leveled (every level above 0 holds one run that grows by FANOUT per level).
+ *
+ * A store directory contains the runs, a MANIFEST that lists the live runs and their levels, a LOCK file
+ * that serializes manifest updates and a COMPACT file held by the running compaction.
+ **/
+
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdbool.h>
+
+/** The compaction policies. */
+enum store_policy {
+    STORE_TIERED,
+    STORE_LEVELED
+};
+
+/** A store that a batch is added to. */
+struct store {
+    const char *dir;
+    enum store_policy policy;
+    bool direct;
+    char *tmp_path;
+    int tmp_fd;
+};
+
+bool store_parse_policy(const char *arg, enum store_policy *policy);
+int store_add_begin(struct store *st);
+void store_add_commit(struct store *st);
+
+int store_main(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,45 @@
+/**
+ * @file trace.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Static tracepoints (USDT) of the provider "forksort".
+ *
+ * If <sys/sdt.h> (systemtap-sdt) is available at build time, every TRACE macro places a probe that is a single nop
+ * until a tracer attaches to it, e.g. "bpftrace -e 'usdt:./forksort:forksort:merge__end { @[arg0] = count(); }'".
+ * Otherwise the macros compile to nothing.
+ *
+ * Probes, arg0 is always the depth of the node in the tree (0 for the root):
+ *  node__start(depth, lines), node__exit(depth, lines)
+ *  fork(depth, pid)
+ *  input__start(depth, pid, lines), input__end(depth, pid, lines): the lines of a child are written
+ *  output__start(depth, lines), output__end(depth, lines): a node produces its sorted lines
+ *  merge__start(depth, lines), merge__end(depth, lines)
+ *  merge__progress(depth, printed): every TRACE_EVERY printed lines
+ *  spill(depth, offset, length): a long line is stored out-of-line
+ **/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/** Defines the number of printed lines between two merge__progress probes. */
+#define TRACE_EVERY 4096
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HAVE_SDT 1
+#endif
+#endif
+
+#ifdef HAVE_SDT
+#define TRACE1(name, a) DTRACE_PROBE1(forksort, name, a)
+#define TRACE2(name, a, b) DTRACE_PROBE2(forksort, name, a, b)
+#define TRACE3(name, a, b, c) DTRACE_PROBE3(forksort, name, a, b, c)
+#else
+#define TRACE1(name, a) do { (void) (a); } while (0)
+#define TRACE2(name, a, b) do { (void) (a); (void) (b); } while (0)
+#define TRACE3(name, a, b, c) do { (void) (a); (void) (b); (void) (c); } while (0)
+#endif
+
+#endif
@@ -0,0 +1,235 @@
+/**
+ * @file watchdog.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Stall detector of the process tree.
+ *
+ * The table is a memfd the root creates after reading its input, the children inherit the descriptor and map it.
+ * It holds one slot per possible node of the tree, a tree over n lines has at most 2 * 2^ceil(log2 n) slots.
+ * Nodes only store their own slot (relaxed atomics), the watchdog only reads.
+ *
+ * The watchdog sums the progress counters every second. If the sum did not change for the configured time, it prints
+ * for every node that has not finished: its pid, depth and phase, the blocking system call and wait channel from
+ * /proc/<pid>/syscall and /proc/<pid>/wchan and its open file descriptors.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "watchdog.h"
+
+/** One node of the tree, pid 0 marks an unused slot. */
+struct watch_slot {
+    int32_t pid;
+    int32_t depth;
+    uint32_t phase;
+    uint32_t pad;
+    uint64_t progress;
+};
+
+static const char *phase_names[] = { "read input", "feed children", "merge", "reap children", "done" };
+
+static struct watch_slot *table = NULL;
+static long slots = 0;
+static long node = 1;
+static struct watch_slot *own = NULL;
+
+static void watch_error(const char *msg) {
+    fprintf(stderr, "watchdog: %s: %s\n", msg, strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+static void map_table(int fd) {
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size <= 0) {
+        watch_error("not a node table");
+    }
+    table = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (table == MAP_FAILED) {
+        watch_error("could not map node table");
+    }
+    slots = size / sizeof(*table);
+    own = node < slots ? &table[node] : NULL;
+}
+
+/**
+ * Watch create function
+ * @brief This function creates the node table of a tree over numlines lines, the caller becomes node 1.
+ * @param numlines The number of lines
+ * @return The file descriptor of the table, inherited by the children
+ */
+int watch_create(int numlines) {
+    long count = 2;
+    while (count < 2L * numlines) {
+        count *= 2;
+    }
+    int fd = memfd_create("forksort-watch", 0);
+    if (fd == -1 || ftruncate(fd, count * sizeof(*table)) == -1) {
+        watch_error("could not create node table");
+    }
+    node = 1;
+    map_table(fd);
+    return fd;
+}
+
+/**
+ * Watch attach function
+ * @brief This function maps the node table a child inherited.
+ * @param fd The file descriptor of the table
+ * @param index The node of this process
+ */
+void watch_attach(int fd, long index) {
+    node = index;
+    map_table(fd);
+}
+
+bool watch_enabled(void) {
+    return table != NULL;
+}
+
+/**
+ * Watch child node function
+ * @return The node of child 0 or 1 of this process
+ */
+long watch_child_node(int which) {
+    return 2 * node + which;
+}
+
+/**
+ * Watch enter function
+ * @brief This function records the phase this node entered.
+ * @param phase The phase
+ * @param depth The depth of this node
+ */
+void watch_enter(enum watch_phase phase, int depth) {
+    if (own == NULL) {
+        return;
+    }
+    __atomic_store_n(&own->depth, depth, __ATOMIC_RELAXED);
+    __atomic_store_n(&own->phase, phase, __ATOMIC_RELAXED);
+    __atomic_store_n(&own->pid, getpid(), __ATOMIC_RELEASE);
+}
+
+/**
+ * Watch tick function
+ * @brief This function counts one line this node read or printed.
+ */
+void watch_tick(void) {
+    if (own != NULL) {
+        __atomic_store_n(&own->progress, own->progress + 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void print_file(const char *label, pid_t pid, const char *name) {
+    char path[64], buf[256];
+    snprintf(path, sizeof(path), "/proc/%d/%s", (int) pid, name);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return;
+    }
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    fprintf(stderr, "  %s: %s\n", label, buf);
+}
+
+static void print_fds(pid_t pid) {
+    char path[64], link[320], target[256];
+    snprintf(path, sizeof(path), "/proc/%d/fd", (int) pid);
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+    fprintf(stderr, "  fds:");
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(link, sizeof(link), "%s/%s", path, entry->d_name);
+        ssize_t n = readlink(link, target, sizeof(target) - 1);
+        if (n == -1) {
+            continue;
+        }
+        target[n] = '\0';
+        fprintf(stderr, " %s->%s", entry->d_name, target);
+    }
+    closedir(dir);
+    fprintf(stderr, "\n");
+}
+
+/**
+ * Report function
+ * @brief This function prints every node that has not finished.
+ */
+static void report(unsigned stalled) {
+    fprintf(stderr, "forksort watchdog: no progress for %u s\n", stalled);
+    for (long i = 1; i < slots; i++) {
+        pid_t pid = __atomic_load_n(&table[i].pid, __ATOMIC_ACQUIRE);
+        uint32_t phase = __atomic_load_n(&table[i].phase, __ATOMIC_RELAXED);
+        if (pid == 0 || phase == WATCH_DONE) {
+            continue;
+        }
+        fprintf(stderr, "node %ld pid %d depth %d phase %s progress %llu\n", i, (int) pid,
+                (int) table[i].depth, phase < WATCH_DONE ? phase_names[phase] : "?",
+                (unsigned long long) table[i].progress);
+        print_file("syscall", pid, "syscall");
+        print_file("wchan", pid, "wchan");
+        print_fds(pid);
+    }
+    fflush(stderr);
+}
+
+/**
+ * Watch start function
+ * @brief This function forks the watchdog, it reports a stall of the given length once per stall and exits with the root.
+ * @param seconds The time without progress that is reported
+ * @return The pid of the watchdog
+ */
+pid_t watch_start(unsigned seconds) {
+    pid_t root = getpid();
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == -1) {
+        watch_error("could not fork watchdog");
+    }
+    if (pid > 0) {
+        return pid;
+    }
+
+    uint64_t last = UINT64_MAX;
+    unsigned stalled = 0;
+    while (getppid() == root) {
+        sleep(1);
+        uint64_t sum = 0;
+        for (long i = 1; i < slots; i++) {
+            sum += __atomic_load_n(&table[i].progress, __ATOMIC_RELAXED);
+        }
+        stalled = sum == last ? stalled + 1 : 0;
+        last = sum;
+        if (stalled == seconds) {
+            report(stalled);
+        }
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+/**
+ * Watch stop function
+ * @brief This function ends the watchdog.
+ * @param pid The pid of the watchdog
+ */
+void watch_stop(pid_t pid) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
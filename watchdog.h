@@ -0,0 +1,39 @@
+/**
+ * @file watchdog.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Stall detector of the process tree.
+ *
+ * Every node of the tree owns a slot of a shared table: its pid, depth, phase and a progress counter.
+ * The slots are numbered like a binary heap, the root is node 1 and the children of node i are 2i and 2i + 1.
+ * A watchdog process forked by the root reports every live node when no counter moved for a while.
+ **/
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/** The phases of a node. */
+enum watch_phase {
+    WATCH_READ,
+    WATCH_FEED,
+    WATCH_MERGE,
+    WATCH_REAP,
+    WATCH_DONE
+};
+
+int watch_create(int numlines);
+void watch_attach(int fd, long node);
+bool watch_enabled(void);
+long watch_child_node(int which);
+
+void watch_enter(enum watch_phase phase, int depth);
+void watch_tick(void);
+
+pid_t watch_start(unsigned seconds);
+void watch_stop(pid_t pid);
+
+#endif
@@ -0,0 +1,257 @@
+/**
+ * @file where.c
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Filters evaluated while the input is read (--where=FILTER).
+ *
+ * The root tests every record in its read buffer before it keeps it, so a rejected record is never copied, stored or
+ * sent to a child and its buffer is reused for the next one. A substring search skips to the candidates with
+ * memchr(), which the C library scans a vector at a time, and compares only where the first and last bytes match.
+ * A regular expression is compiled once to a DFA with ".*" in front, so the search is one pass over the field.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "where.h"
+#include "field.h"
+#include "record.h"
+#include "dfa.h"
+
+/** The comparisons of a filter. */
+enum where_op {
+    OP_CONTAINS,
+    OP_MATCH,
+    OP_NOT_MATCH,
+    OP_EQ,
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE
+};
+
+/** A filter: its field (0 for the whole record), comparison and value. */
+struct filter {
+    size_t field;
+    enum where_op op;
+    const char *value;
+    size_t value_len;
+    bool numeric;
+    double number;
+    struct dfa *dfa;
+};
+
+/** The operators, longer ones before their prefixes. */
+static const struct {
+    const char *text;
+    enum where_op op;
+} ops[] = {
+    { "*=", OP_CONTAINS }, { "!~", OP_NOT_MATCH }, { "~", OP_MATCH }, { "==", OP_EQ }, { "!=", OP_NE },
+    { "<=", OP_LE }, { ">=", OP_GE }, { "<", OP_LT }, { ">", OP_GT }
+};
+
+static struct filter *filters = NULL;
+static size_t numfilters = 0, max_field = 0;
+static struct field *fields = NULL;
+static char *description = NULL;
+
+static void *where_alloc(void *p, size_t size) {
+    p = realloc(p, size > 0 ? size : 1);
+    if (p == NULL) {
+        fprintf(stderr, "where: Unable to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+/**
+ * Parse number function
+ * @brief This function reads the leading decimal number of a string.
+ * @param full Set to true if the number spans the whole string
+ * @return The number, 0 without one
+ */
+static double parse_number(const char *s, size_t len, bool *full) {
+    char buf[64];
+    if (len >= sizeof(buf)) {
+        *full = false;
+        len = sizeof(buf) - 1;
+    } else {
+        *full = len > 0;
+    }
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    char *end;
+    double d = strtod(buf, &end);
+    *full = *full && *end == '\0';
+    return d;
+}
+
+/**
+ * Where add function
+ * @brief This function compiles a filter and adds it to the filters a record has to pass.
+ * @param filter The filter
+ * @param error Set to a message if the filter is invalid
+ * @return false if the filter is invalid
+ */
+bool where_add(const char *filter, const char **error) {
+    struct filter f = { .field = 0, .dfa = NULL };
+    const char *p = filter;
+    if (*p == '$') {
+        char *end;
+        errno = 0;
+        unsigned long n = strtoul(p + 1, &end, 10);
+        if (end == p + 1 || p[1] == '-' || p[1] == '+' || errno != 0 || n > 65535) {
+            *error = "invalid field";
+            return false;
+        }
+        f.field = n;
+        p = end;
+    }
+    size_t i = 0;
+    while (i < sizeof(ops) / sizeof(*ops) && strncmp(p, ops[i].text, strlen(ops[i].text)) != 0) {
+        i++;
+    }
+    if (i == sizeof(ops) / sizeof(*ops)) {
+        *error = "expected one of *= ~ !~ == != < <= > >=";
+        return false;
+    }
+    f.op = ops[i].op;
+    f.value = p + strlen(ops[i].text);
+    f.value_len = strlen(f.value);
+
+    if (f.op == OP_MATCH || f.op == OP_NOT_MATCH) {
+        // the DFA matches at the start of the field, ".*" lets the match start anywhere
+        char *pattern = where_alloc(NULL, f.value_len + sizeof(".*()"));
+        if (f.value[0] == '^') {
+            strcpy(pattern, f.value);
+        } else {
+            sprintf(pattern, ".*(%s)", f.value);
+        }
+        f.dfa = dfa_compile(pattern, error);
+        free(pattern);
+        if (f.dfa == NULL) {
+            return false;
+        }
+    } else if (f.op != OP_CONTAINS) {
+        f.number = parse_number(f.value, f.value_len, &f.numeric);
+    }
+
+    filters = where_alloc(filters, (numfilters + 1) * sizeof(*filters));
+    filters[numfilters++] = f;
+    max_field = f.field > max_field ? f.field : max_field;
+    fields = where_alloc(fields, max_field * sizeof(*fields));
+
+    size_t used = description != NULL ? strlen(description) + 1 : 0;
+    description = where_alloc(description, used + strlen(filter) + 1);
+    if (used > 0) {
+        description[used - 1] = '\n';
+    }
+    strcpy(description + used, filter);
+    return true;
+}
+
+bool where_active(void) {
+    return numfilters > 0;
+}
+
+/**
+ * Where describe function
+ * @return The filters, one per line, "" without filters
+ */
+const char *where_describe(void) {
+    return description != NULL ? description : "";
+}
+
+/**
+ * Contains function
+ * @brief This function searches a needle, jumping between the candidates for its first byte with memchr().
+ */
+static bool contains(const char *s, size_t len, const char *needle, size_t nlen) {
+    if (nlen == 0) {
+        return true;
+    }
+    if (nlen > len) {
+        return false;
+    }
+    const char *end = s + len - nlen + 1;
+    for (const char *p = s; (p = memchr(p, needle[0], end - p)) != NULL; p++) {
+        if (p[nlen - 1] == needle[nlen - 1] && memcmp(p, needle, nlen) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int compare(const char *a, size_t alen, const char *b, size_t blen) {
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+    return c != 0 ? c : (alen > blen) - (alen < blen);
+}
+
+static bool test(const struct filter *f, const char *s, size_t len) {
+    int c;
+    switch (f->op) {
+        case OP_CONTAINS:
+            return contains(s, len, f->value, f->value_len);
+        case OP_MATCH:
+            return dfa_match_prefix(f->dfa, s, len);
+        case OP_NOT_MATCH:
+            return !dfa_match_prefix(f->dfa, s, len);
+        default:
+            break;
+    }
+    if (f->numeric) {
+        bool full;
+        double d = parse_number(s, len, &full);
+        c = (d > f->number) - (d < f->number);
+    } else {
+        c = compare(s, len, f->value, f->value_len);
+    }
+    switch (f->op) {
+        case OP_EQ:
+            return c == 0;
+        case OP_NE:
+            return c != 0;
+        case OP_LT:
+            return c < 0;
+        case OP_LE:
+            return c <= 0;
+        case OP_GT:
+            return c > 0;
+        default:
+            return c >= 0;
+    }
+}
+
+/**
+ * Where match function
+ * @brief This function tests a record against all filters.
+ * @param line The record as it was read, with or without its newline
+ * @param len The length of the record
+ * @return true if the record passes every filter
+ */
+bool where_match(const char *line, size_t len) {
+    if (len > 0 && line[len - 1] == '\n') {
+        len -= 1;
+    }
+    if (record_active()) {
+        line = record_text(line, len, &len);
+    }
+    size_t found = max_field > 0 ? field_split(line, len, fields, max_field) : 0;
+    for (size_t i = 0; i < numfilters; i++) {
+        const struct filter *f = &filters[i];
+        const char *s = line;
+        size_t slen = len;
+        if (f->field > 0) {
+            s = f->field <= found ? line + fields[f->field - 1].start : line;
+            slen = f->field <= found ? fields[f->field - 1].len : 0;
+        }
+        if (!test(f, s, slen)) {
+            return false;
+        }
+    }
+    return true;
+}
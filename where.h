@@ -0,0 +1,30 @@
+/**
+ * @file where.h
+ * @author Giancarlo Buenaflor <e51837398@student.tuwien.ac.at>
+ * @date 18.12.2020
+ *
+ * @brief Filters evaluated while the input is read (--where=FILTER).
+ *
+ * A filter is [$N] OP VALUE, where $N is a field (see field.h) and the whole record without it or with $0:
+ *
+ *     *=              the value occurs in the field
+ *     ~  !~           the regular expression (see dfa.h) matches somewhere in the field, or not; a leading '^'
+ *                     anchors it at the start of the field
+ *     == != < <= > >= the field compares so to the value, as numbers if the value is a number (the field counts as
+ *                     its leading number, 0 without one), bytewise otherwise
+ *
+ * e.g. "*=ERROR", "$3>=100" or "$1~^2020-1[0-2]". A record is kept if it passes every filter.
+ **/
+
+#ifndef WHERE_H
+#define WHERE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+bool where_add(const char *filter, const char **error);
+bool where_active(void);
+const char *where_describe(void);
+bool where_match(const char *line, size_t len);
+
+#endif